@@ -0,0 +1,242 @@
+/**
+ * @file ZlabEchoCapture.cpp
+ * @brief Implementation of the shared interrupt-driven echo capture engine.
+ */
+#include "ZlabEchoCapture.h"
+
+ZlabEchoCapture* ZlabEchoCapture::_instance = nullptr;
+
+// Busy-loop length between a calibration write and the next cycle count. It must
+// outlast the interrupt latency, and unlike delayMicroseconds() it stretches by
+// exactly the time the interrupt takes.
+static const uint32_t CALIBRATION_SPIN = 2000;
+
+// Counts calibration interrupts; the handler does nothing else.
+static volatile uint32_t calibrationHits = 0;
+
+// Private helper: a free-running cycle counter for measuring the handler cost.
+static inline uint32_t IRAM_ATTR captureCycles() {
+#if defined(ESP32)
+    return ESP.getCycleCount();
+#else
+    return micros() * (F_CPU / 1000000UL);
+#endif
+}
+
+// Private helper: the rate captureCycles() counts at. ESP32 sketches can change
+// the CPU clock at run time, and F_CPU only holds the build-time default.
+static uint32_t captureCyclesPerSecond() {
+#if defined(ESP32)
+    return getCpuFrequencyMhz() * 1000000UL;
+#else
+    return F_CPU;
+#endif
+}
+
+// Private helper: the trivial handler used to calibrate the dispatch overhead.
+static void IRAM_ATTR calibrationIsr() {
+    calibrationHits = calibrationHits + 1;
+}
+
+// Private helper: cycles for one write to a pin plus a fixed busy loop.
+static uint32_t timedWrite(uint8_t pin, uint8_t level) {
+    uint32_t start = captureCycles();
+    digitalWrite(pin, level);
+    for (volatile uint32_t i = 0; i < CALIBRATION_SPIN; i++) {
+    }
+    return captureCycles() - start;
+}
+
+// The constructor registers this object as the target of the shared handler.
+ZlabEchoCapture::ZlabEchoCapture() {
+    _channelCount = 0;
+    _levels = 0;
+    _dispatchCycles = 0;
+    _instance = this;
+    resetStats();
+}
+
+// Registers a sensor and configures its pins.
+int8_t ZlabEchoCapture::addChannel(uint8_t trigPin, uint8_t echoPin) {
+    if (_channelCount >= ZLAB_ECHO_CAPTURE_MAX_CHANNELS) {
+        return -1;
+    }
+    _trigPins[_channelCount] = trigPin;
+    _echoPins[_channelCount] = echoPin;
+
+    pinMode(trigPin, OUTPUT);
+    digitalWrite(trigPin, LOW);
+    pinMode(echoPin, INPUT);
+
+    return (int8_t)_channelCount++;
+}
+
+// Attaches the one handler to every echo pin.
+void ZlabEchoCapture::begin() {
+    // Start from the current levels so the first interrupt only reports real changes.
+    uint32_t levels = 0;
+    for (uint8_t ch = 0; ch < _channelCount; ch++) {
+        if (digitalRead(_echoPins[ch]) == HIGH) {
+            levels |= 1UL << ch;
+        }
+    }
+    _levels = levels;
+
+    for (uint8_t ch = 0; ch < _channelCount; ch++) {
+        attachInterrupt(digitalPinToInterrupt(_echoPins[ch]), _isr, CHANGE);
+    }
+}
+
+// Detaches the handler from every echo pin.
+void ZlabEchoCapture::end() {
+    for (uint8_t ch = 0; ch < _channelCount; ch++) {
+        detachInterrupt(digitalPinToInterrupt(_echoPins[ch]));
+    }
+}
+
+// Sends the trigger pulse without waiting for the echo.
+void ZlabEchoCapture::trigger(uint8_t channel) {
+    if (channel >= _channelCount) {
+        return;
+    }
+    // Arm first so the rising edge can never arrive before the channel expects it.
+    _pairer.arm(channel, micros());
+
+    // Send a 10 microsecond pulse to trigger the sensor.
+    digitalWrite(_trigPins[channel], HIGH);
+    delayMicroseconds(10);
+    digitalWrite(_trigPins[channel], LOW);
+}
+
+// Triggers every sensor; their echoes are timed concurrently.
+void ZlabEchoCapture::triggerAll() {
+    for (uint8_t ch = 0; ch < _channelCount; ch++) {
+        trigger(ch);
+    }
+}
+
+// Consumer side: pairs queued edges and expires channels without an echo.
+uint8_t ZlabEchoCapture::update() {
+    uint8_t completed = 0;
+    ZlabEdgeEvent event;
+    while (_queue.pop(event)) {
+        if (_pairer.process(event)) {
+            completed++;
+        }
+    }
+    completed += _pairer.expire(micros(), ZlabUltrasonicMath::ECHO_TIMEOUT_US);
+    return completed;
+}
+
+// Takes the last reading of a channel and converts it to millimeters.
+long ZlabEchoCapture::getDistanceMm(uint8_t channel, int16_t tempDeciC) {
+    return ZlabUltrasonicMath::durationToMm(takeDuration(channel),
+                                            ZlabUltrasonicMath::speedOfSoundCmPerS(tempDeciC));
+}
+
+// Returns a consistent copy of the handler's counters.
+ZlabEchoCaptureStats ZlabEchoCapture::getStats() const {
+    ZlabEchoCaptureStats stats;
+    noInterrupts();
+    stats.isrCalls = _isrCalls;
+    stats.edges = _edges;
+    stats.dropped = _dropped;
+    stats.isrCycles = ((uint64_t)_isrCyclesHi << 32) | _isrCyclesLo;
+    interrupts();
+    return stats;
+}
+
+// Clears the handler's counters.
+void ZlabEchoCapture::resetStats() {
+    noInterrupts();
+    _isrCalls = 0;
+    _edges = 0;
+    _dropped = 0;
+    _isrCyclesLo = 0;
+    _isrCyclesHi = 0;
+    interrupts();
+}
+
+// Measures the extra cycles one interrupt costs around the handler body.
+uint32_t ZlabEchoCapture::calibrateDispatch(uint8_t pin, uint8_t rounds) {
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+
+    // Step 1: The same writes with no handler attached.
+    uint64_t bare = 0;
+    for (uint8_t i = 0; i < rounds; i++) {
+        bare += timedWrite(pin, HIGH);
+        bare += timedWrite(pin, LOW);
+    }
+
+    // Step 2: With a handler that does (almost) nothing.
+    calibrationHits = 0;
+    attachInterrupt(digitalPinToInterrupt(pin), calibrationIsr, CHANGE);
+    uint64_t handled = 0;
+    for (uint8_t i = 0; i < rounds; i++) {
+        handled += timedWrite(pin, HIGH);
+        handled += timedWrite(pin, LOW);
+    }
+    detachInterrupt(digitalPinToInterrupt(pin));
+
+    // Step 3: The difference per interrupt is the dispatch overhead.
+    uint32_t hits = calibrationHits;
+    if (hits == 0 || handled <= bare) {
+        return 0; // The pin cannot raise its own interrupt on this board.
+    }
+    _dispatchCycles = (uint32_t)((handled - bare) / hits);
+    return _dispatchCycles;
+}
+
+// Converts the measured cycles per edge into the highest sustainable edge rate.
+uint32_t ZlabEchoCapture::maxEdgeRateHz() const {
+    ZlabEchoCaptureStats stats = getStats();
+    if (stats.edges == 0 || _dispatchCycles == 0) {
+        return 0;
+    }
+    // Every call pays the dispatch; the body cost is already summed per call.
+    uint64_t cycles = stats.isrCycles + (uint64_t)stats.isrCalls * _dispatchCycles;
+    return (uint32_t)((uint64_t)captureCyclesPerSecond() * stats.edges / cycles);
+}
+
+// The shared interrupt handler for every echo pin.
+void IRAM_ATTR ZlabEchoCapture::_isr() {
+    if (_instance != nullptr) {
+        _instance->_onInterrupt();
+    }
+}
+
+// Producer side: samples all echo pins once and queues every level change.
+void IRAM_ATTR ZlabEchoCapture::_onInterrupt() {
+    uint32_t start = captureCycles();
+    uint32_t now = micros();
+
+    uint32_t levels = 0;
+    for (uint8_t ch = 0; ch < _channelCount; ch++) {
+        if (digitalRead(_echoPins[ch]) == HIGH) {
+            levels |= 1UL << ch;
+        }
+    }
+    uint32_t changed = levels ^ _levels;
+    _levels = levels;
+
+    while (changed != 0) {
+        uint8_t ch = (uint8_t)__builtin_ctz(changed);
+        changed &= changed - 1;
+
+        ZlabEdgeEvent event = {now, ch, (uint8_t)((levels >> ch) & 1)};
+        if (_queue.push(event)) {
+            _edges = _edges + 1;
+        } else {
+            _dropped = _dropped + 1;
+        }
+    }
+
+    _isrCalls = _isrCalls + 1;
+    uint32_t spent = captureCycles() - start;
+    uint32_t lo = _isrCyclesLo + spent;
+    if (lo < spent) {
+        _isrCyclesHi = _isrCyclesHi + 1;
+    }
+    _isrCyclesLo = lo;
+}
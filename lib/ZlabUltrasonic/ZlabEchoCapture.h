@@ -0,0 +1,377 @@
+/**
+ * @file ZlabEchoCapture.h
+ * @brief Shared interrupt-driven echo timing for several sensors.
+ * @details One interrupt handler serves every registered echo pin. It timestamps
+ * each rising and falling edge into a lock-free single-producer/single-consumer
+ * queue. update() drains the queue from loop() and pairs the edges into
+ * per-sensor echo durations. Several sensors can have echoes in flight at once,
+ * and no time is spent polling pins.
+ *
+ * The queue and the pairing logic are free of Arduino dependencies, so their
+ * cost can be measured on a host (see src/capture_bench/).
+ */
+#ifndef ZLAB_ECHO_CAPTURE_H
+#define ZLAB_ECHO_CAPTURE_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "ZlabUltrasonicMath.h"
+
+/// Maximum number of sensors one capture engine can serve (at most 32).
+#ifndef ZLAB_ECHO_CAPTURE_MAX_CHANNELS
+#define ZLAB_ECHO_CAPTURE_MAX_CHANNELS 8
+#endif
+
+static_assert(ZLAB_ECHO_CAPTURE_MAX_CHANNELS <= 32, "one level bit per channel: at most 32 channels");
+
+/// Edge queue capacity; must be a power of two.
+#ifndef ZLAB_ECHO_CAPTURE_QUEUE_SIZE
+#define ZLAB_ECHO_CAPTURE_QUEUE_SIZE 64
+#endif
+
+/**
+ * @struct ZlabEdgeEvent
+ * @brief One timestamped level change on an echo pin.
+ */
+struct ZlabEdgeEvent {
+    uint32_t timestamp_us; ///< micros() when the interrupt saw the change.
+    uint8_t channel;       ///< Channel index returned by addChannel().
+    uint8_t level;         ///< New pin level (1 = rising edge, 0 = falling edge).
+};
+
+/**
+ * @class ZlabEdgeQueue
+ * @brief Lock-free single-producer/single-consumer ring of edge events.
+ * @details push() is called only from the interrupt handler and pop() only from
+ * the consumer. Each index is written by a single side, so acquire/release
+ * ordering is enough: no locks, and interrupts are never masked.
+ * @tparam N Capacity; must be a power of two.
+ */
+template <uint32_t N>
+class ZlabEdgeQueue {
+    static_assert((N & (N - 1)) == 0, "ZlabEdgeQueue size must be a power of two");
+
+public:
+    /// Producer side. Returns false (event dropped) when the queue is full.
+    bool push(const ZlabEdgeEvent& event) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= N) {
+            return false;
+        }
+        _events[head & (N - 1)] = event;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side. Returns false when the queue is empty.
+    bool pop(ZlabEdgeEvent& event) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        event = _events[tail & (N - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    ZlabEdgeEvent _events[N];
+    std::atomic<uint32_t> _head{0}; ///< Written by the producer only.
+    std::atomic<uint32_t> _tail{0}; ///< Written by the consumer only.
+};
+
+/**
+ * @class ZlabEdgePairer
+ * @brief Turns a stream of edge events into per-channel echo durations.
+ * @details A channel is armed when its sensor is triggered. The first rising
+ * edge after that starts the echo and the next falling edge completes it.
+ * Edges on channels that are not armed, or stamped before the channel was
+ * last armed, are ignored as noise, and channel indices out of range are
+ * ignored everywhere.
+ * @tparam CHANNELS Number of channels.
+ */
+template <uint8_t CHANNELS>
+class ZlabEdgePairer {
+public:
+    ZlabEdgePairer() {
+        for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+            _channels[ch] = Channel();
+        }
+    }
+
+    /**
+     * @brief Marks a channel as waiting for an echo.
+     * @param channel The channel that was just triggered.
+     * @param now_us The trigger time in microseconds.
+     */
+    void arm(uint8_t channel, uint32_t now_us) {
+        if (channel >= CHANNELS) {
+            return;
+        }
+        Channel& c = _channels[channel];
+        c.armedAt = now_us;
+        c.armed = true;
+        c.rising = false;
+    }
+
+    /**
+     * @brief Consumes one edge event.
+     * @return True if the event completed a duration on its channel.
+     */
+    bool process(const ZlabEdgeEvent& event) {
+        if (event.channel >= CHANNELS) {
+            return false;
+        }
+        Channel& c = _channels[event.channel];
+        if (!c.armed) {
+            return false;
+        }
+        if ((int32_t)(event.timestamp_us - c.armedAt) < 0) {
+            return false; // Still queued from before this trigger.
+        }
+        if (event.level) {
+            c.riseAt = event.timestamp_us;
+            c.rising = true;
+            return false;
+        }
+        if (!c.rising) {
+            return false; // Falling edge without its rising edge: wait for the next echo.
+        }
+        _complete(c, (long)(event.timestamp_us - c.riseAt));
+        return true;
+    }
+
+    /**
+     * @brief Completes every armed channel that has waited longer than timeout_us.
+     * @return The number of channels that timed out.
+     */
+    uint8_t expire(uint32_t now_us, uint32_t timeout_us) {
+        uint8_t expired = 0;
+        for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+            Channel& c = _channels[ch];
+            if (c.armed && now_us - c.armedAt > timeout_us) {
+                _complete(c, 0);
+                expired++;
+            }
+        }
+        return expired;
+    }
+
+    /// True while a channel waits for its echo.
+    bool inFlight(uint8_t channel) const { return channel < CHANNELS && _channels[channel].armed; }
+
+    /// True if a completed duration is waiting to be taken.
+    bool available(uint8_t channel) const { return channel < CHANNELS && _channels[channel].ready; }
+
+    /**
+     * @brief Takes the last completed duration of a channel.
+     * @return The echo duration in microseconds; 0 on timeout or for an invalid channel.
+     */
+    long take(uint8_t channel) {
+        if (channel >= CHANNELS) {
+            return 0;
+        }
+        _channels[channel].ready = false;
+        return _channels[channel].duration_us;
+    }
+
+private:
+    struct Channel {
+        uint32_t armedAt = 0;
+        uint32_t riseAt = 0;
+        long duration_us = 0;
+        bool armed = false;
+        bool rising = false;
+        bool ready = false;
+    };
+
+    void _complete(Channel& c, long duration_us) {
+        c.duration_us = duration_us;
+        c.armed = false;
+        c.rising = false;
+        c.ready = true;
+    }
+
+    Channel _channels[CHANNELS];
+};
+
+#ifdef ARDUINO
+#include "Arduino.h"
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+/**
+ * @struct ZlabEchoCaptureStats
+ * @brief Cost and health counters of the capture engine.
+ * @details isrCycles covers the handler body only. The GPIO dispatch around it
+ * (interrupt entry, pin lookup, exit) is measured once by calibrateDispatch();
+ * maxEdgeRateHz() adds it per call to get the full cost per edge.
+ */
+struct ZlabEchoCaptureStats {
+    uint32_t isrCalls;  ///< Interrupt handler invocations.
+    uint32_t edges;     ///< Edges queued.
+    uint32_t dropped;   ///< Edges lost because the queue was full.
+    uint64_t isrCycles; ///< CPU cycles spent inside the handler body.
+};
+
+/**
+ * @class ZlabEchoCapture
+ * @brief Times the echoes of several HC-SR04 sensors from a single interrupt handler.
+ * @details Only one instance may exist, because the handler is shared by all pins.
+ *
+ * Typical loop: call triggerAll(), then call update() from loop(). Collect each
+ * available() channel with getDistanceMm(). Sensors that face each other should
+ * be triggered at different times to avoid cross-talk.
+ */
+class ZlabEchoCapture {
+public:
+    ZlabEchoCapture();
+
+    /**
+     * @brief Registers a sensor. Call before begin().
+     * @param trigPin The GPIO pin connected to the sensor's TRIG pin.
+     * @param echoPin The GPIO pin connected to the sensor's ECHO pin.
+     * @return The channel index, or a negative value if all channels are used.
+     */
+    int8_t addChannel(uint8_t trigPin, uint8_t echoPin);
+
+    /**
+     * @brief Attaches the shared interrupt handler to every registered echo pin.
+     */
+    void begin();
+
+    /**
+     * @brief Detaches the interrupt handler.
+     */
+    void end();
+
+    /**
+     * @brief Sends the trigger pulse of one sensor. Does not wait for the echo.
+     * @param channel The channel index.
+     */
+    void trigger(uint8_t channel);
+
+    /**
+     * @brief Triggers every registered sensor back to back.
+     */
+    void triggerAll();
+
+    /**
+     * @brief Drains the edge queue and pairs edges into durations. Call often from loop().
+     * @return The number of channels that completed (echo or timeout) during this call.
+     */
+    uint8_t update();
+
+    /// True while the channel waits for its echo. False for an unregistered channel.
+    bool inFlight(uint8_t channel) const { return channel < _channelCount && _pairer.inFlight(channel); }
+
+    /// True if a completed reading is waiting on the channel. False for an unregistered channel.
+    bool available(uint8_t channel) const { return channel < _channelCount && _pairer.available(channel); }
+
+    /**
+     * @brief Takes the last echo duration of a channel.
+     * @return The duration in microseconds; 0 on timeout or for an unregistered channel.
+     */
+    long takeDuration(uint8_t channel) { return channel < _channelCount ? _pairer.take(channel) : 0; }
+
+    /**
+     * @brief Takes the last reading of a channel as a distance.
+     * @param tempDeciC The ambient temperature in tenths of a degree Celsius.
+     * @return The distance in millimeters. Returns a negative value on timeout or
+     * for an unregistered channel (e.g. the -1 from a failed addChannel()).
+     */
+    long getDistanceMm(uint8_t channel, int16_t tempDeciC = 200);
+
+    /// Number of registered channels.
+    uint8_t channelCount() const { return _channelCount; }
+
+    /// Counters since begin() or the last resetStats().
+    ZlabEchoCaptureStats getStats() const;
+
+    /// Clears the counters.
+    void resetStats();
+
+    /**
+     * @brief Measures the fixed cost of one GPIO interrupt dispatch.
+     * @details Toggles `pin` with and without a trivial handler attached and
+     * keeps the extra cycles per interrupt. On ESP32 an OUTPUT pin reads back
+     * its own level, so the writes raise the pin's interrupt. Use a spare pin,
+     * not an echo pin; call it once, before or after begin().
+     * @param pin A GPIO pin that is not connected to anything else.
+     * @param rounds Number of high/low toggles to average over.
+     * @return Dispatch cycles per interrupt, or 0 if the pin raised no interrupt.
+     */
+    uint32_t calibrateDispatch(uint8_t pin, uint8_t rounds = 32);
+
+    /// Dispatch cycles per interrupt from calibrateDispatch(); 0 before it.
+    uint32_t dispatchCycles() const { return _dispatchCycles; }
+
+    /**
+     * @brief Highest edge rate the handler can keep up with, from the measured cost per edge.
+     * @details The cost per edge is the handler body plus the calibrated dispatch
+     * overhead, which dominates on ESP32. Cycles are converted at the current
+     * CPU clock on ESP32, so call it after any setCpuFrequencyMhz().
+     * @return Edges per second, or 0 before the first edge or before calibrateDispatch().
+     */
+    uint32_t maxEdgeRateHz() const;
+
+private:
+    static void IRAM_ATTR _isr();
+    void IRAM_ATTR _onInterrupt();
+
+    static ZlabEchoCapture* _instance;
+
+    uint8_t _trigPins[ZLAB_ECHO_CAPTURE_MAX_CHANNELS];
+    uint8_t _echoPins[ZLAB_ECHO_CAPTURE_MAX_CHANNELS];
+    uint8_t _channelCount;
+    volatile uint32_t _levels; ///< Last level seen per channel, one bit each.
+    uint32_t _dispatchCycles;  ///< GPIO dispatch cost per interrupt, see calibrateDispatch().
+
+    ZlabEdgeQueue<ZLAB_ECHO_CAPTURE_QUEUE_SIZE> _queue;
+    ZlabEdgePairer<ZLAB_ECHO_CAPTURE_MAX_CHANNELS> _pairer;
+
+    // Written by the handler only.
+    volatile uint32_t _isrCalls;
+    volatile uint32_t _edges;
+    volatile uint32_t _dropped;
+    volatile uint32_t _isrCyclesLo;
+    volatile uint32_t _isrCyclesHi;
+};
+
+#include "ZlabScan.h"
+
+/**
+ * @class ZlabEchoCaptureScanSensor
+ * @brief Uses one capture channel as a fully non-blocking ZlabScanEngine sensor.
+ */
+class ZlabEchoCaptureScanSensor : public ZlabRangeSensor {
+public:
+    ZlabEchoCaptureScanSensor(ZlabEchoCapture& capture, uint8_t channel, int16_t tempDeciC = 200)
+        : _capture(capture), _channel(channel), _tempDeciC(tempDeciC) {}
+
+    void startPing(uint32_t now_us) override {
+        (void)now_us;
+        _capture.trigger(_channel);
+    }
+
+    bool pollResult(uint32_t now_us, long& distance_mm) override {
+        (void)now_us;
+        _capture.update();
+        if (!_capture.available(_channel)) {
+            return false;
+        }
+        distance_mm = _capture.getDistanceMm(_channel, _tempDeciC);
+        return true;
+    }
+
+private:
+    ZlabEchoCapture& _capture;
+    uint8_t _channel;
+    int16_t _tempDeciC;
+};
+#endif
+
+#endif // ZLAB_ECHO_CAPTURE_H
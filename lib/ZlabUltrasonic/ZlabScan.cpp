@@ -0,0 +1,108 @@
+/**
+ * @file ZlabScan.cpp
+ * @brief Implementation of the pipelined scan engine.
+ */
+#include "ZlabScan.h"
+
+// Wrap-safe "a is at or after b" for microsecond timestamps.
+static bool reached(uint32_t now_us, uint32_t deadline_us) {
+    return (int32_t)(now_us - deadline_us) >= 0;
+}
+
+ZlabScanEngine::ZlabScanEngine(ZlabServoDriver& servo, ZlabRangeSensor& sensor, ZlabScanSink& sink,
+                               const ZlabScanConfig& config)
+    : _servo(servo), _sensor(sensor), _sink(sink), _config(config) {
+    if (_config.stepDeg <= 0) {
+        _config.stepDeg = 1;
+    }
+    if (_config.endDeg < _config.startDeg) {
+        _config.endDeg = _config.startDeg;
+    }
+    _bins = (uint16_t)((_config.endDeg - _config.startDeg) / _config.stepDeg + 1);
+    _bin = 0;
+    _direction = 1;
+    _state = State::IDLE;
+    _pingAt = 0;
+    _lastPingAt = 0;
+    _hasPinged = false;
+    _sweeps = 0;
+}
+
+// Starts the first sweep from startDeg.
+void ZlabScanEngine::begin(uint32_t now_us) {
+    _bin = 0;
+    _direction = 1;
+    _sweeps = 0;
+    _hasPinged = false;
+
+    // The servo position is unknown: allow for a full-range move.
+    _servo.setAngle(_angleOf(0));
+    _pingAt = now_us + (uint32_t)(_config.endDeg - _config.startDeg) * _config.servoUsPerDeg
+              + _config.servoSettleUs - _config.pingLeadUs;
+    _state = State::MOVING;
+}
+
+// Commands the servo to a bin and schedules the ping for it.
+void ZlabScanEngine::_moveTo(uint16_t bin, uint32_t now_us) {
+    int16_t delta = (int16_t)(_angleOf(bin) - _angleOf(_bin));
+    if (delta < 0) {
+        delta = (int16_t)-delta;
+    }
+    _bin = bin;
+    _servo.setAngle(_angleOf(bin));
+
+    // Ping just before the servo settles, so the sensor's own trigger-to-burst
+    // latency overlaps the end of the settle time.
+    uint32_t settled = now_us + (uint32_t)delta * _config.servoUsPerDeg + _config.servoSettleUs;
+    _pingAt = settled - _config.pingLeadUs;
+
+    // ...but never sooner than the sensor may ping again.
+    uint32_t ready = _lastPingAt + _config.minPingIntervalUs;
+    if (_hasPinged && !reached(_pingAt, ready)) {
+        _pingAt = ready;
+    }
+    _state = State::MOVING;
+}
+
+// Advances the state machine.
+bool ZlabScanEngine::update(uint32_t now_us) {
+    switch (_state) {
+        case State::IDLE:
+            return false;
+
+        case State::MOVING:
+            if (!reached(now_us, _pingAt)) {
+                return false;
+            }
+            _sensor.startPing(now_us);
+            _lastPingAt = now_us;
+            _hasPinged = true;
+            _state = State::PINGING;
+            // The sensor may already be done (blocking sensors), so fall through.
+            // fallthrough
+
+        case State::PINGING: {
+            long distance_mm;
+            if (!_sensor.pollResult(now_us, distance_mm)) {
+                return false;
+            }
+            _sink.onReading(_bin, _angleOf(_bin), distance_mm);
+
+            // Reverse at either end of the sweep.
+            if ((_direction > 0 && _bin + 1 >= _bins) || (_direction < 0 && _bin == 0)) {
+                _direction = (int8_t)-_direction;
+                _sweeps++;
+            }
+            // now_us may predate a blocking read, so the move waits for the next
+            // update() and its fresh timestamp.
+            _pingAt = now_us;
+            _state = State::STEPPING;
+            return true;
+        }
+
+        case State::STEPPING:
+            _moveTo(_bins == 1 ? 0 : (uint16_t)(_bin + _direction), now_us);
+            return false;
+    }
+    return false;
+}
@@ -0,0 +1,357 @@
+/**
+ * @file ZlabScan.h
+ * @brief Servo-swept polar scanning and incremental polar/occupancy grids.
+ * @details The scan engine is a non-blocking state machine driven by update(now).
+ * The servo and the range sensor sit behind small interfaces, so the same engine
+ * runs on the board and in the Linux simulator (see src/scan_sim/). Everything
+ * except the Arduino adapters at the end of this file is free of Arduino
+ * dependencies.
+ */
+#ifndef ZLAB_SCAN_H
+#define ZLAB_SCAN_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include "ZlabUltrasonicMath.h"
+
+/**
+ * @class ZlabServoDriver
+ * @brief Positions the servo that carries the sensor.
+ */
+class ZlabServoDriver {
+public:
+    virtual ~ZlabServoDriver() {}
+
+    /**
+     * @brief Commands a new angle. Must return immediately; the engine itself
+     * accounts for travel and settle time.
+     * @param angleDeg The target angle in degrees.
+     */
+    virtual void setAngle(int16_t angleDeg) = 0;
+};
+
+/**
+ * @class ZlabRangeSensor
+ * @brief Starts a ping and reports its result without blocking the scan engine.
+ */
+class ZlabRangeSensor {
+public:
+    virtual ~ZlabRangeSensor() {}
+
+    /**
+     * @brief Triggers a measurement.
+     * @param now_us The current time in microseconds.
+     */
+    virtual void startPing(uint32_t now_us) = 0;
+
+    /**
+     * @brief Checks whether the measurement started by startPing() has finished.
+     * @param now_us The current time in microseconds.
+     * @param distance_mm Receives the distance in millimeters; negative on timeout.
+     * @return True once the result is available.
+     */
+    virtual bool pollResult(uint32_t now_us, long& distance_mm) = 0;
+};
+
+/**
+ * @class ZlabScanSink
+ * @brief Receives one reading per scan step.
+ */
+class ZlabScanSink {
+public:
+    virtual ~ZlabScanSink() {}
+
+    /**
+     * @param bin The step index within the sweep (0 = startDeg).
+     * @param angleDeg The angle the reading was taken at.
+     * @param distance_mm The distance in millimeters; negative when there was no echo.
+     */
+    virtual void onReading(uint16_t bin, int16_t angleDeg, long distance_mm) = 0;
+};
+
+/**
+ * @class ZlabCellListener
+ * @brief Notified by ZlabPolarGrid whenever the stored range of a bin changes.
+ */
+class ZlabCellListener {
+public:
+    virtual ~ZlabCellListener() {}
+
+    /**
+     * @param angleDeg The angle of the changed bin.
+     * @param oldMm The previous range in millimeters; negative if there was none.
+     * @param newMm The new range in millimeters; negative if there is none.
+     */
+    virtual void onCellChanged(int16_t angleDeg, long oldMm, long newMm) = 0;
+};
+
+/**
+ * @struct ZlabScanConfig
+ * @brief Sweep geometry and timing. The defaults fit an SG90 servo and an HC-SR04.
+ */
+struct ZlabScanConfig {
+    int16_t startDeg = 0;              ///< First angle of the sweep.
+    int16_t endDeg = 180;              ///< Last angle of the sweep.
+    int16_t stepDeg = 2;               ///< Angle between readings.
+    uint16_t servoUsPerDeg = 1700;     ///< Servo travel time per degree (SG90: ~0.1 s / 60°).
+    uint16_t servoSettleUs = 5000;     ///< Ringing time after the servo reaches its target.
+    uint16_t pingLeadUs = 450;         ///< Trigger-to-burst latency that may overlap the settle tail.
+    /// Minimum time between two triggers: the sensor's full measurement cycle.
+    uint16_t minPingIntervalUs = (uint16_t)ZlabUltrasonicMath::PING_CYCLE_US;
+};
+
+static_assert(ZlabUltrasonicMath::PING_CYCLE_US <= 65535, "minPingIntervalUs is 16 bits");
+
+/**
+ * @class ZlabScanEngine
+ * @brief Pipelines servo steps with pings to build a sweep.
+ * @details The next servo move is commanded on the first update() after an echo
+ * is in, and the next ping is fired pingLeadUs before the move is expected to
+ * settle, or when the sensor may ping again, whichever comes later. The move is
+ * timed from that update()'s timestamp, so a sensor that blocks inside
+ * startPing() cannot make the engine count settle time from before the read.
+ * Settle time is computed from the actual step size, not a fixed worst-case
+ * delay. Sweeps alternate direction so there is never a long return move.
+ */
+class ZlabScanEngine {
+public:
+    /**
+     * @param servo The servo carrying the sensor.
+     * @param sensor The range sensor.
+     * @param sink Receives every reading, e.g. a ZlabPolarGrid.
+     * @param config Sweep geometry and timing.
+     */
+    ZlabScanEngine(ZlabServoDriver& servo, ZlabRangeSensor& sensor, ZlabScanSink& sink,
+                   const ZlabScanConfig& config = ZlabScanConfig());
+
+    /**
+     * @brief Moves the servo to the start angle and starts scanning.
+     * @param now_us The current time in microseconds.
+     */
+    void begin(uint32_t now_us);
+
+    /**
+     * @brief Advances the scan. Call as often as possible.
+     * @param now_us The current time in microseconds.
+     * @return True if a reading was delivered to the sink during this call.
+     */
+    bool update(uint32_t now_us);
+
+    /// Number of readings per sweep.
+    uint16_t binCount() const { return _bins; }
+
+    /// Number of completed sweeps.
+    uint32_t sweeps() const { return _sweeps; }
+
+    /// True while waiting for the sensor's result.
+    bool isPinging() const { return _state == State::PINGING; }
+
+    /// Earliest time at which update() has work to do while the servo moves.
+    uint32_t nextPingUs() const { return _pingAt; }
+
+private:
+    enum class State : uint8_t { IDLE, MOVING, PINGING, STEPPING };
+
+    void _moveTo(uint16_t bin, uint32_t now_us);
+    int16_t _angleOf(uint16_t bin) const { return (int16_t)(_config.startDeg + bin * _config.stepDeg); }
+
+    ZlabServoDriver& _servo;
+    ZlabRangeSensor& _sensor;
+    ZlabScanSink& _sink;
+    ZlabScanConfig _config;
+
+    uint16_t _bins;          ///< Readings per sweep.
+    uint16_t _bin;           ///< Current step index.
+    int8_t _direction;       ///< +1 sweeping up, -1 sweeping down.
+    State _state;
+    uint32_t _pingAt;        ///< When the next ping may be fired (or the next move made).
+    uint32_t _lastPingAt;    ///< Time of the previous trigger.
+    bool _hasPinged;         ///< False until the first trigger.
+    uint32_t _sweeps;
+};
+
+/**
+ * @class ZlabPolarGrid
+ * @brief One byte per bearing: the last range, quantized.
+ * @details A bin holds UNKNOWN before its first reading, NO_ECHO after a timeout,
+ * otherwise the range in units of resolutionMm (1..254). Only bins whose
+ * quantized value changes are reported to the listener.
+ * @tparam BINS Capacity; must be at least ZlabScanEngine::binCount().
+ */
+template <uint16_t BINS>
+class ZlabPolarGrid : public ZlabScanSink {
+public:
+    static const uint8_t UNKNOWN = 0;   ///< No reading yet.
+    static const uint8_t NO_ECHO = 255; ///< Last reading timed out or was out of range.
+
+    /**
+     * @param resolutionMm Size of one range step. 20 mm covers 5 m in a byte.
+     */
+    explicit ZlabPolarGrid(uint16_t resolutionMm = 20) : _resolutionMm(resolutionMm) {
+        clear();
+    }
+
+    /// Resets every bin to UNKNOWN.
+    void clear() {
+        for (uint16_t i = 0; i < BINS; i++) {
+            _cells[i] = UNKNOWN;
+        }
+        _changes = 0;
+    }
+
+    /// Forwards changed bins to an occupancy grid or other consumer (may be nullptr).
+    void setListener(ZlabCellListener* listener) { _listener = listener; }
+
+    void onReading(uint16_t bin, int16_t angleDeg, long distance_mm) override {
+        if (bin >= BINS) {
+            return;
+        }
+        uint8_t cell = _quantize(distance_mm);
+        if (cell == _cells[bin]) {
+            return; // Unchanged: nothing downstream to update.
+        }
+        long oldMm = distanceMm(bin);
+        _cells[bin] = cell;
+        _changes++;
+        if (_listener != nullptr) {
+            _listener->onCellChanged(angleDeg, oldMm, distanceMm(bin));
+        }
+    }
+
+    /// Raw quantized value of a bin.
+    uint8_t cell(uint16_t bin) const { return bin < BINS ? _cells[bin] : UNKNOWN; }
+
+    /// Range of a bin in millimeters; negative for UNKNOWN and NO_ECHO.
+    long distanceMm(uint16_t bin) const {
+        uint8_t c = cell(bin);
+        return (c == UNKNOWN || c == NO_ECHO) ? -1 : (long)c * _resolutionMm;
+    }
+
+    /// Number of bin updates that changed a value since clear().
+    uint32_t changes() const { return _changes; }
+
+private:
+    uint8_t _quantize(long distance_mm) const {
+        if (distance_mm <= 0) {
+            return NO_ECHO;
+        }
+        long q = (distance_mm + _resolutionMm / 2) / _resolutionMm;
+        if (q < 1) q = 1;
+        return q > 254 ? NO_ECHO : (uint8_t)q;
+    }
+
+    uint8_t _cells[BINS];
+    uint16_t _resolutionMm;
+    uint32_t _changes;
+    ZlabCellListener* _listener = nullptr;
+};
+
+/**
+ * @class ZlabOccupancyGrid
+ * @brief Cartesian hit-count grid fed incrementally from a ZlabPolarGrid.
+ * @details The sensor sits at the middle of the bottom row; 90° points up the
+ * grid. Each change moves one endpoint: the old cell is decremented, the new
+ * one incremented. A full sweep therefore touches only as many cells as bins
+ * changed. Counts (not bits) keep two bearings that hit the same cell correct.
+ * @tparam W Grid width in cells.
+ * @tparam H Grid height in cells.
+ */
+template <uint16_t W, uint16_t H>
+class ZlabOccupancyGrid : public ZlabCellListener {
+public:
+    /**
+     * @param cellMm Edge length of one cell in millimeters.
+     */
+    explicit ZlabOccupancyGrid(uint16_t cellMm = 50) : _cellMm(cellMm) { clear(); }
+
+    /// Empties the grid.
+    void clear() {
+        for (uint32_t i = 0; i < (uint32_t)W * H; i++) {
+            _hits[i] = 0;
+        }
+        _touched = 0;
+    }
+
+    void onCellChanged(int16_t angleDeg, long oldMm, long newMm) override {
+        _adjust(angleDeg, oldMm, -1);
+        _adjust(angleDeg, newMm, +1);
+    }
+
+    /// True if at least one bearing currently ends in cell (x, y).
+    bool occupied(uint16_t x, uint16_t y) const {
+        return x < W && y < H && _hits[(uint32_t)y * W + x] > 0;
+    }
+
+    /// Number of cell writes since clear().
+    uint32_t touched() const { return _touched; }
+
+private:
+    void _adjust(int16_t angleDeg, long distance_mm, int8_t delta) {
+        if (distance_mm <= 0) {
+            return;
+        }
+        float rad = angleDeg * (float)M_PI / 180.0f;
+        long x = (long)W / 2 + lroundf(distance_mm * cosf(rad) / _cellMm);
+        long y = lroundf(distance_mm * sinf(rad) / _cellMm);
+        if (x < 0 || x >= W || y < 0 || y >= H) {
+            return;
+        }
+        uint8_t& hits = _hits[(uint32_t)y * W + x];
+        if (delta > 0 ? hits < 255 : hits > 0) {
+            hits += delta;
+            _touched++;
+        }
+    }
+
+    uint8_t _hits[(uint32_t)W * H];
+    uint16_t _cellMm;
+    uint32_t _touched;
+};
+
+#ifdef ARDUINO
+#include "ZlabUltrasonic.h"
+
+/**
+ * @class ZlabServoAdapter
+ * @brief Adapts any servo class with a write(int degrees) method (Servo, ESP32Servo, ...).
+ */
+template <typename ServoT>
+class ZlabServoAdapter : public ZlabServoDriver {
+public:
+    explicit ZlabServoAdapter(ServoT& servo) : _servo(servo) {}
+    void setAngle(int16_t angleDeg) override { _servo.write(angleDeg); }
+
+private:
+    ServoT& _servo;
+};
+
+/**
+ * @class ZlabUltrasonicScanSensor
+ * @brief Uses a ZlabUltrasonic as the scan engine's range sensor.
+ * @details The echo itself is measured with the sensor's usual blocking read
+ * inside startPing(); the engine still overlaps servo travel and settle with
+ * the ping interval, and starts the next move on the following update().
+ */
+class ZlabUltrasonicScanSensor : public ZlabRangeSensor {
+public:
+    explicit ZlabUltrasonicScanSensor(ZlabUltrasonic& sensor) : _sensor(sensor) {}
+
+    void startPing(uint32_t now_us) override {
+        (void)now_us;
+        _distanceMm = _sensor.getDistanceMm();
+    }
+
+    bool pollResult(uint32_t now_us, long& distance_mm) override {
+        (void)now_us;
+        distance_mm = _distanceMm;
+        return true;
+    }
+
+private:
+    ZlabUltrasonic& _sensor;
+    long _distanceMm = -1;
+};
+#endif
+
+#endif // ZLAB_SCAN_H
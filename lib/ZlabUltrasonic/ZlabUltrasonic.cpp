@@ -4,6 +4,12 @@
  */
 #include "ZlabUltrasonic.h"
 
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+// Sleep in 1ms steps only while the window is at least this far away, so the
+// last (possibly longer) tick still wakes us before the window opens.
+static const long TRACKING_SLEEP_SLACK_US = 2000;
+#endif
+
 // The constructor sets up the pins and default values.
 ZlabUltrasonic::ZlabUltrasonic(uint8_t trigPin, uint8_t echoPin) {
     _trigPin = trigPin;
@@ -12,17 +18,69 @@ ZlabUltrasonic::ZlabUltrasonic(uint8_t trigPin, uint8_t echoPin) {
     pinMode(_trigPin, OUTPUT);
     pinMode(_echoPin, INPUT);
 
+#if ZLAB_ULTRASONIC_ENABLE_TEMPERATURE
     // Set a default temperature for initial calculations.
-    setTemperature(20.0);
+    setTemperatureDeciC(200);
+#endif
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+    enableTracking(false);
+#endif
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+    resetStats();
+#endif
+}
+
+#if ZLAB_ULTRASONIC_ENABLE_TEMPERATURE
+// Sets the temperature (in 0.1°C steps) for accurate calculations.
+void ZlabUltrasonic::setTemperatureDeciC(int16_t tempDeciC) {
+    _temperatureDeciC = tempDeciC;
 }
 
+#if ZLAB_ULTRASONIC_ENABLE_FLOAT
 // Sets the temperature for accurate calculations.
 void ZlabUltrasonic::setTemperature(float tempC) {
-    _temperatureC = tempC;
+    // Round to the nearest tenth of a degree.
+    setTemperatureDeciC((int16_t)(tempC * 10.0f + (tempC < 0 ? -0.5f : 0.5f)));
 }
+#endif
+#endif
 
-// Private function to get the raw pulse duration from the sensor.
-long ZlabUltrasonic::_getRawPulseDuration() {
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+// Clears the ping/timeout counters.
+void ZlabUltrasonic::resetStats() {
+    _stats.pings = 0;
+    _stats.timeouts = 0;
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+    _stats.trackedPings = 0;
+    _stats.windowHits = 0;
+    _stats.windowMisses = 0;
+    _stats.reclaimedUs = 0;
+    _stats.trackedEchoUs = 0;
+#endif
+}
+#endif
+
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+// Turns prediction-gated capture on or off.
+void ZlabUltrasonic::enableTracking(bool enable, uint16_t minGuard_us) {
+    _tracking = enable;
+    _trackingGuardUs = minGuard_us;
+    // Start from a full-range search either way.
+    _predictor = ZlabUltrasonicMath::EchoPredictor();
+}
+#endif
+
+// Private function to get the current speed of sound in cm/s.
+uint32_t ZlabUltrasonic::_speedOfSoundCmPerS() const {
+#if ZLAB_ULTRASONIC_ENABLE_TEMPERATURE
+    return ZlabUltrasonicMath::speedOfSoundCmPerS(_temperatureDeciC);
+#else
+    return ZlabUltrasonicMath::speedOfSoundCmPerS(200); // Fixed at 20°C.
+#endif
+}
+
+// Private function to send the trigger pulse.
+void ZlabUltrasonic::_trigger() {
     // Send a 10 microsecond pulse to trigger the sensor.
     digitalWrite(_trigPin, LOW);
     delayMicroseconds(2);
@@ -30,32 +88,162 @@ long ZlabUltrasonic::_getRawPulseDuration() {
     delayMicroseconds(10);
     digitalWrite(_trigPin, LOW);
 
-    // Read the echo pulse duration.
-    // pulseIn() waits for the pin to go HIGH, starts timing, then waits for the
-    // pin to go LOW and stops timing. The duration is returned in microseconds.
-    // A timeout of 30,000µs (30ms) is used to prevent blocking indefinitely.
-    return pulseIn(_echoPin, HIGH, 30000);
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+    _stats.pings++;
+#endif
 }
 
-// Calculates and returns the distance.
-float ZlabUltrasonic::getDistance(Unit unit) {
-    long duration = _getRawPulseDuration();
+// Private function to get the raw pulse duration from the sensor.
+long ZlabUltrasonic::_getRawPulseDuration() {
+    long duration;
 
-    // If duration is 0, it indicates a timeout (error).
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+    if (_tracking && _predictor.ready()) {
+        duration = _getTrackedPulseDuration();
+    } else
+#endif
+    {
+        _trigger();
+
+        // Read the echo pulse duration.
+        // pulseIn() waits for the pin to go HIGH, starts timing, then waits for the
+        // pin to go LOW and stops timing. The duration is returned in microseconds.
+        // A timeout of 30,000µs (30ms) is used to prevent blocking indefinitely.
+        duration = pulseIn(_echoPin, HIGH, ZlabUltrasonicMath::ECHO_TIMEOUT_US);
+    }
+
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+    if (_tracking) {
+        _predictor.update(duration);
+    }
+#endif
+#if ZLAB_ULTRASONIC_ENABLE_STATS
     if (duration == 0) {
-        return -1.0f;
+        _stats.timeouts++;
+    }
+#endif
+    return duration;
+}
+
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+// Private function to measure the echo inside the predicted window.
+long ZlabUltrasonic::_getTrackedPulseDuration() {
+    long guard = _predictor.guard(_trackingGuardUs);
+    long windowOpen = _predictor.predicted() - guard;
+    long windowClose = _predictor.predicted() + guard;
+
+    _trigger();
+    unsigned long triggered = micros();
+
+    // Step 1: Wait for the echo to start. The sensor raises ECHO right after its
+    // burst, so this wait is short and independent of the distance.
+    unsigned long start = micros();
+    while (digitalRead(_echoPin) == LOW) {
+        if (micros() - start >= (unsigned long)ZlabUltrasonicMath::ECHO_TIMEOUT_US) {
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+            _stats.trackedPings++;
+            _stats.windowMisses++;
+#endif
+            return 0;
+        }
+    }
+    unsigned long rise = micros();
+
+    // Step 2: Yield the CPU until shortly before the window opens.
+    bool slept = false;
+    while (windowOpen - (long)(micros() - rise) > TRACKING_SLEEP_SLACK_US) {
+        delay(1);
+        slept = true;
+    }
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+    unsigned long awake = micros();
+    _stats.trackedPings++;
+    if (slept) {
+        _stats.reclaimedUs += awake - rise;
+    }
+#endif
+
+    // Step 3: If the echo already ended while we slept, its timing is lost.
+    // Fall back to a full-range search with a fresh ping, once the first
+    // ping's measurement cycle is over and its ghost echoes are gone.
+    if (slept && digitalRead(_echoPin) == LOW) {
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+        _stats.windowMisses++;
+        _stats.trackedEchoUs += awake - rise;
+#endif
+        unsigned long elapsed = micros() - triggered;
+        if (elapsed < (unsigned long)ZlabUltrasonicMath::PING_CYCLE_US) {
+            unsigned long remaining = ZlabUltrasonicMath::PING_CYCLE_US - elapsed;
+            delay(remaining / 1000);
+            delayMicroseconds(remaining % 1000);
+        }
+        _trigger();
+        return pulseIn(_echoPin, HIGH, ZlabUltrasonicMath::ECHO_TIMEOUT_US);
+    }
+
+    // Step 4: Poll for the falling edge. Past the window this continues up to the
+    // normal timeout, so a late echo is still measured (and counted as a miss).
+    while (digitalRead(_echoPin) == HIGH) {
+        if (micros() - rise >= (unsigned long)ZlabUltrasonicMath::ECHO_TIMEOUT_US) {
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+            _stats.windowMisses++;
+            _stats.trackedEchoUs += micros() - rise;
+#endif
+            return 0;
+        }
     }
+    long duration = (long)(micros() - rise);
 
-    // Calculate the speed of sound in meters/second based on temperature.
-    float speedOfSound_mps = 331.3 + 0.606 * _temperatureC;
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+    if (duration >= windowOpen && duration <= windowClose) {
+        _stats.windowHits++;
+    } else {
+        _stats.windowMisses++;
+    }
+    _stats.trackedEchoUs += duration;
+#else
+    (void)windowClose;
+#endif
+    return duration;
+}
+#endif
 
-    // Convert duration (µs) to seconds and calculate distance in cm.
-    // Formula: distance = (duration * speed_of_sound) / 2
-    float distance_cm = (duration * 0.000001 * speedOfSound_mps * 100) / 2.0;
+// Calculates and returns the distance in millimeters with integer math.
+long ZlabUltrasonic::getDistanceMm() {
+    // A duration of 0 (timeout) converts to a negative value (error).
+    return ZlabUltrasonicMath::durationToMm(_getRawPulseDuration(), _speedOfSoundCmPerS());
+}
+
+// Checks if an object is within the specified threshold (integer version).
+bool ZlabUltrasonic::isObjectDetectedMm(long threshold_mm) {
+    long currentDistance = getDistanceMm();
+
+    // Return true only if the reading is valid ( > 0) and within the threshold.
+    return currentDistance > 0 && currentDistance <= threshold_mm;
+}
+
+#if ZLAB_ULTRASONIC_ENABLE_FLOAT
+// Calculates and returns the distance.
+float ZlabUltrasonic::getDistance(Unit unit) {
+#if ZLAB_ULTRASONIC_ENABLE_TEMPERATURE
+    float tempC = _temperatureDeciC / 10.0f;
+#else
+    float tempC = 20.0f;
+#endif
+    float distance_cm = ZlabUltrasonicMath::durationToCm(_getRawPulseDuration(), tempC);
 
+    // If the reading is negative, it indicates a timeout (error).
+    if (distance_cm < 0) {
+        return distance_cm;
+    }
+
+#if ZLAB_ULTRASONIC_ENABLE_UNITS
     if (unit == Unit::INCH) {
-        return distance_cm / 2.54;
+        return ZlabUltrasonicMath::cmToInch(distance_cm);
     }
+#else
+    (void)unit;
+#endif
     return distance_cm;
 }
 
@@ -69,31 +257,40 @@ bool ZlabUltrasonic::isObjectDetected(float threshold_cm) {
     }
     return false;
 }
+#endif
 
-// Calculates a stable distance reading by averaging over 100ms.
-float ZlabUltrasonic::getMovingAverageDistance(int sample_interval_ms) {
-    std::vector<float> readings;
+#if ZLAB_ULTRASONIC_ENABLE_AVERAGING
+// Calculates a stable distance reading (mm) by averaging over 100ms.
+long ZlabUltrasonic::getMovingAverageDistanceMm(int sample_interval_ms) {
+    // A running sum replaces the sample buffer: no heap use, constant RAM.
+    ZlabUltrasonicMath::Average<long> average;
     unsigned long startTime = millis();
-    const int sampling_duration_ms = 100; // Total duration to read samples.
 
-    // Step 1: Collect data for 100 milliseconds.
-    while (millis() - startTime < sampling_duration_ms) {
-        float dist = getDistance(Unit::CM);
-        if (dist > 0) { // Only store valid readings.
-            readings.push_back(dist);
-        }
+    // Step 1: Collect data for 100 milliseconds (invalid readings are skipped).
+    while (millis() - startTime < ZlabUltrasonicMath::AVERAGE_WINDOW_MS) {
+        average.add(getDistanceMm());
         delay(sample_interval_ms);
     }
 
-    // Step 2: If no valid data was collected, return an error.
-    if (readings.empty()) {
-        return -1.0f;
-    }
+    // Step 2: Return the rounded average, or an error if nothing was valid.
+    return average.result();
+}
 
-    // Step 3: Calculate and return the average of the valid readings.
-    float sum = 0;
-    for (float r : readings) {
-        sum += r;
+#if ZLAB_ULTRASONIC_ENABLE_FLOAT
+// Calculates a stable distance reading by averaging over 100ms.
+float ZlabUltrasonic::getMovingAverageDistance(int sample_interval_ms) {
+    // A running sum replaces the sample buffer: no heap use, constant RAM.
+    ZlabUltrasonicMath::Average<float> average;
+    unsigned long startTime = millis();
+
+    // Step 1: Collect data for 100 milliseconds (invalid readings are skipped).
+    while (millis() - startTime < ZlabUltrasonicMath::AVERAGE_WINDOW_MS) {
+        average.add(getDistance(Unit::CM));
+        delay(sample_interval_ms);
     }
-    return sum / readings.size();
-}
\ No newline at end of file
+
+    // Step 2: Return the average, or an error if nothing was valid.
+    return average.result();
+}
+#endif
+#endif
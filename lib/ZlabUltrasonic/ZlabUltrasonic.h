@@ -12,7 +12,42 @@
 #define ZLAB_ULTRASONIC_H
 
 #include "Arduino.h"
-#include <vector>
+#include "ZlabUltrasonicMath.h"
+
+// --- Compile-time feature selection ---
+// Each optional subsystem can be switched off with a build flag, e.g.
+// `-D ZLAB_ULTRASONIC_ENABLE_FLOAT=0`. A disabled subsystem contributes no code
+// and no per-instance RAM. The integer API (getDistanceMm()) is always built.
+
+/// Float API: getDistance(), isObjectDetected(), getMovingAverageDistance(), setTemperature().
+#ifndef ZLAB_ULTRASONIC_ENABLE_FLOAT
+#define ZLAB_ULTRASONIC_ENABLE_FLOAT 1
+#endif
+
+/// Unit conversion (Unit::INCH). Only meaningful together with the float API.
+#ifndef ZLAB_ULTRASONIC_ENABLE_UNITS
+#define ZLAB_ULTRASONIC_ENABLE_UNITS 1
+#endif
+
+/// Temperature compensation. When disabled, the speed of sound at 20°C is used.
+#ifndef ZLAB_ULTRASONIC_ENABLE_TEMPERATURE
+#define ZLAB_ULTRASONIC_ENABLE_TEMPERATURE 1
+#endif
+
+/// Moving-average filtering over a 100 ms window.
+#ifndef ZLAB_ULTRASONIC_ENABLE_AVERAGING
+#define ZLAB_ULTRASONIC_ENABLE_AVERAGING 1
+#endif
+
+/// Prediction-gated echo capture, see enableTracking().
+#ifndef ZLAB_ULTRASONIC_ENABLE_TRACKING
+#define ZLAB_ULTRASONIC_ENABLE_TRACKING 0
+#endif
+
+/// Ping/timeout counters, see getStats().
+#ifndef ZLAB_ULTRASONIC_ENABLE_STATS
+#define ZLAB_ULTRASONIC_ENABLE_STATS 0
+#endif
 
 /**
  * @enum Unit
@@ -20,8 +55,28 @@
  */
 enum class Unit {
     CM,   ///< Centimeters
+#if ZLAB_ULTRASONIC_ENABLE_UNITS
     INCH  ///< Inches
+#endif
+};
+
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+/**
+ * @struct ZlabUltrasonicStats
+ * @brief Running counters collected by a sensor instance.
+ */
+struct ZlabUltrasonicStats {
+    uint32_t pings;     ///< Number of trigger pulses sent.
+    uint32_t timeouts;  ///< Number of pings that returned no echo.
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+    uint32_t trackedPings;  ///< Readings captured with a predicted window.
+    uint32_t windowHits;    ///< Echo ended inside the guard window.
+    uint32_t windowMisses;  ///< Echo ended outside the window or timed out.
+    uint64_t reclaimedUs;   ///< Time yielded to other tasks instead of polling the echo pin.
+    uint64_t trackedEchoUs; ///< Total echo time of tracked readings; reclaimedUs / trackedEchoUs is the CPU share freed.
+#endif
 };
+#endif
 
 /**
  * @class ZlabUltrasonic
@@ -42,6 +97,20 @@ public:
      */
     ZlabUltrasonic(uint8_t trigPin, uint8_t echoPin);
 
+    /**
+     * @brief Gets the distance to an object in millimeters using integer math only.
+     * @return The distance in millimeters. Returns a negative value on error.
+     */
+    long getDistanceMm();
+
+    /**
+     * @brief Checks if an object is detected within a given distance threshold.
+     * @param threshold_mm The distance threshold in millimeters.
+     * @return True if an object is detected at or closer than the threshold, false otherwise.
+     */
+    bool isObjectDetectedMm(long threshold_mm);
+
+#if ZLAB_ULTRASONIC_ENABLE_FLOAT
     /**
      * @brief Gets the distance to an object, with a selectable unit.
      * @details This function measures the distance and returns it in the specified
@@ -57,7 +126,18 @@ public:
      * @return True if an object is detected at or closer than the threshold, false otherwise.
      */
     bool isObjectDetected(float threshold_cm);
+#endif
+
+#if ZLAB_ULTRASONIC_ENABLE_AVERAGING
+    /**
+     * @brief Gets an averaged distance in millimeters using integer math only.
+     * @details Same sampling scheme as getMovingAverageDistance().
+     * @param sample_interval_ms The delay in milliseconds between each sample.
+     * @return The filtered distance in millimeters. Returns a negative value on error.
+     */
+    long getMovingAverageDistanceMm(int sample_interval_ms = 10);
 
+#if ZLAB_ULTRASONIC_ENABLE_FLOAT
     /**
      * @brief Gets a noise-free distance reading by averaging measurements over 100ms.
      * @details This function is ideal for dynamic environments, like a moving robot.
@@ -67,12 +147,53 @@ public:
      * @return The filtered distance in centimeters. Returns a negative value on error.
      */
     float getMovingAverageDistance(int sample_interval_ms = 10);
+#endif
+#endif
 
+#if ZLAB_ULTRASONIC_ENABLE_TEMPERATURE
+    /**
+     * @brief Sets the ambient temperature in tenths of a degree Celsius.
+     * @param tempDeciC The ambient temperature, e.g. 255 for 25.5°C.
+     */
+    void setTemperatureDeciC(int16_t tempDeciC);
+
+#if ZLAB_ULTRASONIC_ENABLE_FLOAT
     /**
      * @brief Sets the ambient temperature for more accurate speed of sound calculations.
      * @param tempC The ambient temperature in Celsius.
      */
     void setTemperature(float tempC);
+#endif
+#endif
+
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+    /**
+     * @brief Enables or disables prediction-gated echo capture.
+     * @details Once two consecutive readings are valid, the next echo length is
+     * predicted from them. After the echo starts, the CPU is yielded with delay()
+     * until shortly before a guard window around the predicted end, then the pin is
+     * polled. If the echo ended while the CPU was yielded, the sensor is pinged again
+     * with a full-range search once the first ping's 60ms measurement cycle is over,
+     * so ghost echoes of the first burst cannot be read. Best suited to targets that
+     * move slowly compared to the ping rate; on ESP32 the yielded time goes to other
+     * FreeRTOS tasks.
+     * @param enable True to enable tracking.
+     * @param minGuard_us Minimum half-width of the guard window in microseconds.
+     */
+    void enableTracking(bool enable = true, uint16_t minGuard_us = 150);
+#endif
+
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+    /**
+     * @brief Returns the counters collected since construction or the last resetStats().
+     */
+    const ZlabUltrasonicStats& getStats() const { return _stats; }
+
+    /**
+     * @brief Clears all counters.
+     */
+    void resetStats();
+#endif
 
 private:
     /**
@@ -81,9 +202,37 @@ private:
      */
     long _getRawPulseDuration();
 
+    /**
+     * @brief Sends the 10µs trigger pulse.
+     */
+    void _trigger();
+
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+    /**
+     * @brief Measures the echo using the predicted capture window.
+     * @return The echo pulse duration in microseconds. Returns 0 on timeout.
+     */
+    long _getTrackedPulseDuration();
+#endif
+
+    /**
+     * @brief Returns the current speed of sound in centimeters per second.
+     */
+    uint32_t _speedOfSoundCmPerS() const;
+
     uint8_t _trigPin;      ///< GPIO pin for the trigger.
     uint8_t _echoPin;      ///< GPIO pin for the echo.
-    float _temperatureC;   ///< Stores the current ambient temperature in Celsius.
+#if ZLAB_ULTRASONIC_ENABLE_TEMPERATURE
+    int16_t _temperatureDeciC; ///< Stores the current ambient temperature in tenths of a degree Celsius.
+#endif
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+    ZlabUltrasonicMath::EchoPredictor _predictor; ///< Recent durations for tracking mode.
+    uint16_t _trackingGuardUs;  ///< Minimum guard half-width in microseconds.
+    bool _tracking;             ///< True when tracking mode is enabled.
+#endif
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+    ZlabUltrasonicStats _stats; ///< Running ping/timeout counters.
+#endif
 };
 
-#endif // ZLAB_ULTRASONIC_H
\ No newline at end of file
+#endif // ZLAB_ULTRASONIC_H
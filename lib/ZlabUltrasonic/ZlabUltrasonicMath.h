@@ -0,0 +1,155 @@
+/**
+ * @file ZlabUltrasonicMath.h
+ * @brief Conversion and filter math shared by the driver and host-side tools.
+ * @details Everything in this header is free of Arduino dependencies so the exact
+ * same code can run on the sensor and in offline tools (see src/replay/).
+ */
+#ifndef ZLAB_ULTRASONIC_MATH_H
+#define ZLAB_ULTRASONIC_MATH_H
+
+#include <stdint.h>
+
+namespace ZlabUltrasonicMath {
+
+/// Echo timeout used by the driver, in microseconds.
+const long ECHO_TIMEOUT_US = 30000;
+
+/// Minimum time from one trigger to the next, in microseconds. An HC-SR04
+/// holds ECHO high for ~38ms when nothing answers and ignores triggers until
+/// then; the rest lets residual echoes of the last burst die out.
+const long PING_CYCLE_US = 60000;
+
+/// Length of the moving-average sampling window, in milliseconds.
+const int AVERAGE_WINDOW_MS = 100;
+
+/**
+ * @brief Returns the speed of sound in centimeters per second.
+ * @details 331.3 m/s at 0°C plus 0.606 m/s per °C, i.e. 6.06 cm/s per 0.1°C.
+ * @param tempDeciC The ambient temperature in tenths of a degree Celsius.
+ */
+inline uint32_t speedOfSoundCmPerS(int16_t tempDeciC) {
+    return (uint32_t)(33130L + (606L * tempDeciC) / 100L);
+}
+
+/**
+ * @brief Converts an echo duration to a distance in millimeters using integer math.
+ * @param duration_us The echo pulse duration in microseconds (0 means timeout),
+ * at most ECHO_TIMEOUT_US. Callers with untrusted input must range-check it.
+ * @param speedCmPerS The speed of sound, see speedOfSoundCmPerS().
+ * @return The distance in millimeters. Returns a negative value on timeout.
+ */
+inline long durationToMm(long duration_us, uint32_t speedCmPerS) {
+    if (duration_us <= 0) {
+        return -1;
+    }
+    // distance_mm = duration_us * speed_cm_s * 10 / 1e6 / 2, rounded.
+    // 30,000µs * ~36,000cm/s stays well inside 32 bits.
+    return (long)(((uint32_t)duration_us * speedCmPerS + 100000UL) / 200000UL);
+}
+
+/**
+ * @brief Converts an echo duration to a distance in centimeters.
+ * @param duration_us The echo pulse duration in microseconds (0 means timeout).
+ * @param tempC The ambient temperature in Celsius.
+ * @return The distance in centimeters. Returns a negative value on timeout.
+ */
+inline float durationToCm(long duration_us, float tempC) {
+    if (duration_us <= 0) {
+        return -1.0f;
+    }
+    // Calculate the speed of sound in meters/second based on temperature.
+    float speedOfSound_mps = 331.3f + 0.606f * tempC;
+
+    // Convert duration (µs) to seconds and calculate distance in cm.
+    // Formula: distance = (duration * speed_of_sound) / 2
+    return (duration_us * 0.000001f * speedOfSound_mps * 100) / 2.0f;
+}
+
+/**
+ * @brief Converts centimeters to inches.
+ */
+inline float cmToInch(float cm) {
+    return cm / 2.54f;
+}
+
+/**
+ * @struct Average
+ * @brief Running average of valid readings, as used by the moving-average filter.
+ * @details Invalid (non-positive) readings are ignored. T is long for the
+ * millimeter filter and float for the centimeter filter.
+ */
+template <typename T>
+struct Average {
+    T sum = 0;       ///< Sum of the valid readings.
+    long count = 0;  ///< Number of valid readings.
+
+    /// Adds a reading; negative/zero readings are discarded.
+    void add(T reading) {
+        if (reading > 0) {
+            sum += reading;
+            count++;
+        }
+    }
+
+    /// Merges another partial average into this one.
+    void merge(const Average& other) {
+        sum += other.sum;
+        count += other.count;
+    }
+
+    /// Returns the average, or a negative value if no valid reading was added.
+    T result() const;
+};
+
+template <>
+inline long Average<long>::result() const {
+    // Rounded integer average.
+    return count == 0 ? -1 : (sum + count / 2) / count;
+}
+
+template <>
+inline float Average<float>::result() const {
+    return count == 0 ? -1.0f : sum / count;
+}
+
+/**
+ * @struct EchoPredictor
+ * @brief Predicts the next echo duration from the last two valid readings.
+ * @details Used by the tracking capture mode. The prediction is a linear
+ * extrapolation; the guard window widens with the last change so a moving
+ * target stays inside it.
+ */
+struct EchoPredictor {
+    uint16_t last = 0;  ///< Most recent valid duration (µs).
+    uint16_t prev = 0;  ///< The one before it (µs).
+    uint8_t valid = 0;  ///< Number of consecutive valid readings, capped at 2.
+
+    /// Feeds a new reading; a timeout (0) restarts the history.
+    void update(long duration_us) {
+        if (duration_us <= 0 || duration_us > ECHO_TIMEOUT_US) {
+            valid = 0;
+            return;
+        }
+        prev = last;
+        last = (uint16_t)duration_us;
+        if (valid < 2) {
+            valid++;
+        }
+    }
+
+    /// True once two consecutive valid readings are available.
+    bool ready() const { return valid >= 2; }
+
+    /// Predicted duration of the next echo in microseconds.
+    long predicted() const { return 2L * last - prev; }
+
+    /// Half-width of the window around predicted(), in microseconds.
+    long guard(long minGuard_us) const {
+        long change = (long)last - prev;
+        return minGuard_us + 2 * (change < 0 ? -change : change);
+    }
+};
+
+} // namespace ZlabUltrasonicMath
+
+#endif // ZLAB_ULTRASONIC_MATH_H
@@ -0,0 +1,145 @@
+"""
+PlatformIO extra script: adds a `footprint` target that reports code size and
+static RAM for the current environment and fails when it exceeds the budget
+set in platformio.ini.
+
+    pio run -e footprint_minimal -e footprint_integer -e footprint_full -t footprint
+
+Budgets (bytes, all required; the last two only with a baseline):
+    custom_footprint_flash_budget        -> driver .text + .data
+    custom_footprint_ram_budget          -> driver .data + .bss
+    custom_footprint_delta_flash_budget  -> firmware flash minus the baseline's
+    custom_footprint_delta_ram_budget    -> firmware static RAM minus the baseline's
+
+Only the ZlabUltrasonic driver object is budgeted; the scan and capture
+engines in the same library are separate objects and are not linked unless
+used. The driver object does not include what it pulls in at link time (soft
+float and libm for the float API), so the firmware delta against
+custom_footprint_baseline is budgeted as well. The baseline must be listed
+earlier in the same run: its ELF is rejected when any footprint input
+(platformio.ini, the library, the sketch) is newer than it.
+
+On Xtensa, .literal pools count as text. A missing budget fails the target;
+every line prints the measured value plus 10% headroom as a suggestion.
+"""
+import glob
+import os
+import subprocess
+
+Import("env")
+
+
+DRIVER_OBJECT = "ZlabUltrasonic.cpp.o"
+HEADROOM = 1.10
+
+
+def _berkeley_size(env, path, member=None):
+    """Returns (text, data, bss) of `path`, or of one archive member."""
+    out = subprocess.check_output(
+        [env.subst("$SIZETOOL"), "-B", "-t", path], universal_newlines=True
+    )
+    # Lines: text data bss dec hex filename; with -t the last one is the total.
+    lines = out.strip().splitlines()
+    if member is None:
+        fields = lines[-1].split()
+    else:
+        matches = [l.split() for l in lines[1:-1] if l.split()[5] == member]
+        if not matches:
+            return None
+        fields = matches[0]
+    return int(fields[0]), int(fields[1]), int(fields[2])
+
+
+def _budget(env, option):
+    value = env.GetProjectOption(option, "")
+    return int(value) if value else None
+
+
+def _check(env, label, used, option):
+    """Prints one budget line; returns True when the budget is missing or exceeded."""
+    budget = _budget(env, option)
+    suggestion = "(suggest %s = %d)" % (option, int(max(used, 0) * HEADROOM))
+    if budget is None:
+        print("  %-14s %6d B   NO BUDGET %s" % (label, used, suggestion))
+        return True
+    status = "OK" if used <= budget else "OVER BUDGET " + suggestion
+    print("  %-14s %6d / %6d B   %s" % (label, used, budget, status))
+    return used > budget
+
+
+def _newest_input(env):
+    """Returns (mtime, path) of the newest file a footprint build depends on."""
+    project = env.subst("$PROJECT_DIR")
+    paths = [os.path.join(project, "platformio.ini")]
+    for folder in (os.path.join(project, "lib", "ZlabUltrasonic"),
+                   os.path.join(env.subst("$PROJECT_SRC_DIR"), "footprint")):
+        paths += glob.glob(os.path.join(folder, "*"))
+    return max((os.path.getmtime(p), p) for p in paths if os.path.isfile(p))
+
+
+def footprint_report(target, source, env):
+    env_name = env.subst("$PIOENV")
+    elf = env.subst("$BUILD_DIR/${PROGNAME}.elf")
+    archives = glob.glob(
+        os.path.join(env.subst("$BUILD_DIR"), "lib*", "libZlabUltrasonic.a")
+    )
+
+    text, data, bss = _berkeley_size(env, elf)
+    fw_flash = text + data
+    fw_ram = data + bss
+    print("")
+    print("Footprint [%s]" % env_name)
+    print("  firmware   flash %8d B   static RAM %8d B" % (fw_flash, fw_ram))
+
+    if not archives:
+        print("  ZlabUltrasonic archive not found in %s" % env.subst("$BUILD_DIR"))
+        return 1
+
+    sizes = _berkeley_size(env, archives[0], DRIVER_OBJECT)
+    if sizes is None:
+        print("  %s not found in %s" % (DRIVER_OBJECT, archives[0]))
+        return 1
+    text, data, bss = sizes
+    lib_flash = text + data
+    lib_ram = data + bss
+    print("  driver     flash %8d B   static RAM %8d B" % (lib_flash, lib_ram))
+
+    failed = _check(env, "driver flash", lib_flash, "custom_footprint_flash_budget")
+    failed = _check(env, "driver RAM", lib_ram, "custom_footprint_ram_budget") or failed
+
+    baseline = env.GetProjectOption("custom_footprint_baseline", "")
+    if baseline:
+        base_elf = os.path.join(
+            env.subst("$PROJECT_BUILD_DIR"), baseline, env.subst("${PROGNAME}.elf")
+        )
+        if not os.path.isfile(base_elf):
+            print("  baseline [%s] not built; list -e %s first" % (baseline, baseline))
+            return 1
+        newest, path = _newest_input(env)
+        if os.path.getmtime(base_elf) < newest:
+            print("  baseline [%s] is older than %s; list -e %s first"
+                  % (baseline, os.path.relpath(path, env.subst("$PROJECT_DIR")), baseline))
+            return 1
+        text, data, bss = _berkeley_size(env, base_elf)
+        delta_flash = fw_flash - (text + data)
+        delta_ram = fw_ram - (data + bss)
+        print("  growth     flash %+8d B   static RAM %+8d B   (vs %s)"
+              % (delta_flash, delta_ram, baseline))
+        failed = _check(env, "delta flash", delta_flash,
+                        "custom_footprint_delta_flash_budget") or failed
+        failed = _check(env, "delta RAM", delta_ram,
+                        "custom_footprint_delta_ram_budget") or failed
+
+    if failed:
+        print("Footprint budget missing or exceeded for [%s]" % env_name)
+        return 1
+    return 0
+
+
+env.AddCustomTarget(
+    name="footprint",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=[footprint_report],
+    title="Footprint",
+    description="Report code size / static RAM and check the footprint budgets",
+)
@@ -0,0 +1,162 @@
+/**
+ * @file main.cpp
+ * @brief capture-bench: cost per edge of the shared echo capture engine.
+ * @details Host-side (Linux) benchmark of the portable part of ZlabEchoCapture:
+ * the lock-free edge queue and the edge pairer. Echoes on all channels overlap,
+ * as when every sensor is triggered at once.
+ *
+ *  1. Correctness: every paired duration must match the simulated one.
+ *  2. Single thread: producer (interrupt) cost and consumer (loop) cost per edge.
+ *  3. Two threads: the queue hand-off under contention, producer on its own thread.
+ *
+ * None of these numbers is an edge rate the board can sustain: on target the
+ * GPIO interrupt dispatch dominates. That rate comes from
+ * ZlabEchoCapture::calibrateDispatch() and maxEdgeRateHz().
+ *
+ * Build and run: pio run -e capture_bench && .pio/build/capture_bench/program
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "ZlabEchoCapture.h"
+
+namespace {
+
+const uint8_t CHANNELS = ZLAB_ECHO_CAPTURE_MAX_CHANNELS;
+typedef ZlabEdgeQueue<ZLAB_ECHO_CAPTURE_QUEUE_SIZE> Queue;
+typedef ZlabEdgePairer<ZLAB_ECHO_CAPTURE_MAX_CHANNELS> Pairer;
+
+/// One round: all channels rise together, then fall in a channel-dependent order.
+struct Round {
+    ZlabEdgeEvent edges[2 * CHANNELS];
+    long duration[CHANNELS];
+};
+
+Round makeRound(uint32_t start, uint32_t seed) {
+    Round round;
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+        round.edges[ch] = {start + 450 + ch, ch, 1};
+        // Pseudo-random durations from 150 µs to ~25 ms, so falls interleave.
+        seed = seed * 1103515245u + 12345u;
+        round.duration[ch] = 150 + (long)((seed >> 8) % 25000);
+    }
+    ZlabEdgeEvent* falls = round.edges + CHANNELS;
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+        falls[ch] = {round.edges[ch].timestamp_us + (uint32_t)round.duration[ch], ch, 0};
+    }
+    std::sort(falls, falls + CHANNELS, [](const ZlabEdgeEvent& a, const ZlabEdgeEvent& b) {
+        return a.timestamp_us < b.timestamp_us;
+    });
+    return round;
+}
+
+double nsSince(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+}
+
+/// Pairs one round through queue and pairer and checks every duration.
+bool checkRound(const Round& round, Queue& queue, Pairer& pairer) {
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) pairer.arm(ch, round.edges[ch].timestamp_us - 450);
+    for (const ZlabEdgeEvent& e : round.edges) {
+        if (!queue.push(e)) return false;
+    }
+    ZlabEdgeEvent e;
+    while (queue.pop(e)) pairer.process(e);
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+        if (!pairer.available(ch) || pairer.take(ch) != round.duration[ch]) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    uint32_t rounds = 200000;
+    if (argc > 1) rounds = (uint32_t)std::max(1, atoi(argv[1]));
+
+    static Queue queue;
+    Pairer pairer;
+    std::vector<Round> work;
+    work.reserve(256);
+    for (uint32_t i = 0; i < 256; i++) work.push_back(makeRound(i * 40000u, i + 1));
+
+    // 1. Correctness with every channel in flight at once.
+    for (const Round& round : work) {
+        if (!checkRound(round, queue, pairer)) {
+            fprintf(stderr, "pairing mismatch\n");
+            return 1;
+        }
+    }
+    printf("channels: %u, queue: %u events, overlapping echoes paired correctly\n", CHANNELS,
+           ZLAB_ECHO_CAPTURE_QUEUE_SIZE);
+
+    // 2. Single thread: push cost (interrupt side) and pop + pair cost (loop side).
+    const uint32_t edgesPerRound = 2 * CHANNELS;
+    double pushNs = 0, consumeNs = 0;
+    uint64_t completed = 0;
+    for (uint32_t r = 0; r < rounds; r++) {
+        const Round& round = work[r & 255];
+        for (uint8_t ch = 0; ch < CHANNELS; ch++) pairer.arm(ch, round.edges[ch].timestamp_us - 450);
+
+        auto t0 = std::chrono::steady_clock::now();
+        for (const ZlabEdgeEvent& e : round.edges) queue.push(e);
+        pushNs += nsSince(t0);
+
+        t0 = std::chrono::steady_clock::now();
+        ZlabEdgeEvent e;
+        while (queue.pop(e)) completed += pairer.process(e);
+        for (uint8_t ch = 0; ch < CHANNELS; ch++) pairer.take(ch);
+        consumeNs += nsSince(t0);
+    }
+    double edges = (double)rounds * edgesPerRound;
+    printf("single thread: push %.1f ns/edge, pop+pair %.1f ns/edge, %llu durations\n", pushNs / edges,
+           consumeNs / edges, (unsigned long long)completed);
+
+    // 3. Producer thread vs consumer thread, producer spinning when the queue is full.
+    static Queue shared;
+    std::atomic<bool> done{false};
+    uint64_t spins = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    std::thread producer([&] {
+        for (uint32_t r = 0; r < rounds; r++) {
+            for (const ZlabEdgeEvent& e : work[r & 255].edges) {
+                while (!shared.push(e)) {
+                    spins++;
+                    std::this_thread::yield();
+                }
+            }
+        }
+        done.store(true, std::memory_order_release);
+    });
+    uint64_t consumed = 0;
+    ZlabEdgeEvent e;
+    Pairer threadPairer;
+    for (;;) {
+        if (shared.pop(e)) {
+            consumed++;
+            // Re-arm on every rising edge: the loop would have triggered this channel.
+            if (e.level) threadPairer.arm(e.channel, e.timestamp_us);
+            threadPairer.process(e);
+            continue;
+        }
+        if (done.load(std::memory_order_acquire)) {
+            if (!shared.pop(e)) break;
+            consumed++;
+            threadPairer.process(e);
+            continue;
+        }
+        std::this_thread::yield();
+    }
+    producer.join();
+    double seconds = nsSince(t0) / 1e9;
+    printf("two threads, host queue only: %.1f M edges/s (%llu edges, producer waited on full queue %llu times, %u cores)\n",
+           consumed / seconds / 1e6, (unsigned long long)consumed, (unsigned long long)spins,
+           std::thread::hardware_concurrency());
+    return consumed == (uint64_t)edges ? 0 : 1;
+}
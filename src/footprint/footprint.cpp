@@ -0,0 +1,65 @@
+/**
+ * @file footprint.cpp
+ * @brief Size-measurement sketch for the footprint_* environments.
+ * @details Calls every API that the active ZLAB_ULTRASONIC_ENABLE_* flags
+ * provide, so the linker keeps exactly the code a real application of that
+ * configuration would pull in. Run `pio run -e <env> -t footprint` to report.
+ */
+#include <Arduino.h>
+#include "ZlabUltrasonic.h"
+
+// Per-instance RAM budget, set per environment in platformio.ini.
+#ifdef ZLAB_FOOTPRINT_INSTANCE_BUDGET
+static_assert(sizeof(ZlabUltrasonic) <= ZLAB_FOOTPRINT_INSTANCE_BUDGET,
+              "ZlabUltrasonic instance grew past its footprint budget");
+#endif
+
+ZlabUltrasonic sensor(5, 6);
+
+// Results are written here so the calls cannot be optimized away.
+volatile long resultMm;
+#if ZLAB_ULTRASONIC_ENABLE_FLOAT
+volatile float resultCm;
+#endif
+
+void setup() {
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+    sensor.enableTracking();
+#endif
+#if ZLAB_ULTRASONIC_ENABLE_TEMPERATURE
+#if ZLAB_ULTRASONIC_ENABLE_FLOAT
+    sensor.setTemperature(25.0f);
+#else
+    sensor.setTemperatureDeciC(250);
+#endif
+#endif
+}
+
+void loop() {
+    resultMm = sensor.getDistanceMm();
+    resultMm = sensor.isObjectDetectedMm(300);
+
+#if ZLAB_ULTRASONIC_ENABLE_AVERAGING
+    resultMm = sensor.getMovingAverageDistanceMm();
+#endif
+
+#if ZLAB_ULTRASONIC_ENABLE_FLOAT
+    resultCm = sensor.getDistance(Unit::CM);
+    resultCm = sensor.isObjectDetected(30.0f);
+#if ZLAB_ULTRASONIC_ENABLE_UNITS
+    resultCm = sensor.getDistance(Unit::INCH);
+#endif
+#if ZLAB_ULTRASONIC_ENABLE_AVERAGING
+    resultCm = sensor.getMovingAverageDistance();
+#endif
+#endif
+
+#if ZLAB_ULTRASONIC_ENABLE_STATS
+    resultMm = sensor.getStats().timeouts;
+#if ZLAB_ULTRASONIC_ENABLE_TRACKING
+    resultMm = sensor.getStats().windowHits;
+#endif
+#endif
+
+    delay(100);
+}
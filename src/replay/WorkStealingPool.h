@@ -0,0 +1,89 @@
+/**
+ * @file WorkStealingPool.h
+ * @brief Minimal work-stealing thread pool for the replay tool.
+ * @details Tasks are dealt round-robin onto one deque per worker. A worker pops
+ * from the back of its own deque and, once that is empty, steals from the front
+ * of the others. Uneven chunks (e.g. one unit logging far more than the rest)
+ * therefore never leave cores idle while work remains.
+ */
+#ifndef ZLAB_REPLAY_WORK_STEALING_POOL_H
+#define ZLAB_REPLAY_WORK_STEALING_POOL_H
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+template <typename Task>
+class WorkStealingPool {
+public:
+    /**
+     * @param workers Number of worker threads (at least one).
+     */
+    explicit WorkStealingPool(unsigned workers)
+        : _queues(workers == 0 ? 1 : workers) {}
+
+    /// Number of worker threads.
+    unsigned size() const { return (unsigned)_queues.size(); }
+
+    /// Queues a task. Must be called before run().
+    void submit(const Task& task) {
+        _queues[_next++ % _queues.size()].tasks.push_back(task);
+    }
+
+    /**
+     * @brief Runs all queued tasks and returns once every one has finished.
+     * @param fn Called as fn(workerIndex, task); workerIndex is stable per thread
+     * so callers can keep per-worker state without locking.
+     */
+    template <typename Fn>
+    void run(Fn fn) {
+        std::vector<std::thread> threads;
+        for (unsigned w = 0; w < size(); w++) {
+            threads.emplace_back([this, w, &fn] {
+                Task task;
+                while (_popOrSteal(w, task)) {
+                    fn(w, task);
+                }
+            });
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    bool _popOrSteal(unsigned self, Task& out) {
+        {
+            Queue& own = _queues[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                out = own.tasks.back();
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        // Nothing left locally: steal the oldest task from another worker.
+        for (unsigned i = 1; i < size(); i++) {
+            Queue& victim = _queues[(self + i) % size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                out = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        // No new tasks are ever added during run(), so empty everywhere means done.
+        return false;
+    }
+
+    std::vector<Queue> _queues;
+    size_t _next = 0;
+};
+
+#endif // ZLAB_REPLAY_WORK_STEALING_POOL_H
@@ -0,0 +1,434 @@
+/**
+ * @file main.cpp
+ * @brief zlab-replay: re-runs the library's conversion and filter math on raw echo logs.
+ * @details Host-side (Linux) tool. Each input file is memory-mapped, split into
+ * newline-aligned chunks and processed by a work-stealing thread pool. Results
+ * are merged into one summary per unit and written to stdout as CSV.
+ *
+ * Output is batched: a unit's records can span chunks and files, and filter
+ * windows can straddle chunk boundaries, so no row is final until every chunk
+ * has been merged.
+ *
+ * Log format, one ping per line ('#' starts a comment):
+ *
+ *     <unit_id>,<millis>,<duration_us>[,<temp_deci_c>]
+ *
+ * A duration of 0 is a timeout, exactly as returned by pulseIn(); durations
+ * above the 30 ms echo timeout, temperatures outside -40..+85 C and numbers
+ * longer than 18 digits are counted as malformed. Records of a
+ * unit must be in time order; different units may be interleaved freely.
+ *
+ * Build and run: pio run -e replay && .pio/build/replay/program <log>...
+ */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "WorkStealingPool.h"
+#include "ZlabUltrasonicMath.h"
+
+using ZlabUltrasonicMath::Average;
+
+namespace {
+
+// --- Distance distribution ---
+const long HISTOGRAM_BIN_MM = 50;
+const int HISTOGRAM_BINS = 101; // 0..5000 mm, last bin collects everything beyond.
+
+// --- Record limits ---
+// Plausible ambient range for an HC-SR04 deployment, in 0.1 C (-40 C .. +85 C).
+// Anything outside is a corrupt record, and would wrap the int16_t temperature.
+const long MIN_TEMP_DECI_C = -400;
+const long MAX_TEMP_DECI_C = 850;
+// Longer digit runs are corrupt and could overflow a 64-bit long.
+const int MAX_DIGITS = 18;
+
+// --- Options ---
+struct Options {
+    unsigned threads = 0;       ///< 0 = one per core.
+    size_t chunkBytes = 4u << 20;
+    int16_t tempDeciC = 200;    ///< Used when a record has no temperature field.
+    bool histogram = false;
+    bool quiet = false;
+};
+
+/// One contiguous, newline-aligned slice of a mapped file.
+struct Chunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+};
+
+/// A 100 ms filter window that touches a chunk boundary and may continue elsewhere.
+struct WindowFragment {
+    std::string_view unit;
+    long window = 0;
+    Average<long> average;
+};
+
+/// Everything known about one unit; mergeable across workers.
+struct UnitSummary {
+    uint64_t pings = 0;
+    uint64_t timeouts = 0;
+    long minMm = -1;
+    long maxMm = -1;
+    uint64_t sumMm = 0;
+    uint64_t histogram[HISTOGRAM_BINS] = {};
+
+    // Filter outputs: one getMovingAverageDistanceMm() result per 100 ms window.
+    uint64_t windows = 0;
+    uint64_t filterErrors = 0; ///< Windows without a single valid reading.
+    long filteredMinMm = -1;
+    long filteredMaxMm = -1;
+    uint64_t filteredSumMm = 0;
+
+    void addDistance(long mm) {
+        if (minMm < 0 || mm < minMm) minMm = mm;
+        if (mm > maxMm) maxMm = mm;
+        sumMm += (uint64_t)mm;
+        histogram[std::min<long>(mm / HISTOGRAM_BIN_MM, HISTOGRAM_BINS - 1)]++;
+    }
+
+    void addWindow(const Average<long>& average) {
+        windows++;
+        long filtered = average.result();
+        if (filtered < 0) {
+            filterErrors++;
+            return;
+        }
+        if (filteredMinMm < 0 || filtered < filteredMinMm) filteredMinMm = filtered;
+        if (filtered > filteredMaxMm) filteredMaxMm = filtered;
+        filteredSumMm += (uint64_t)filtered;
+    }
+
+    void merge(const UnitSummary& o) {
+        pings += o.pings;
+        timeouts += o.timeouts;
+        if (o.minMm >= 0 && (minMm < 0 || o.minMm < minMm)) minMm = o.minMm;
+        if (o.maxMm > maxMm) maxMm = o.maxMm;
+        sumMm += o.sumMm;
+        for (int i = 0; i < HISTOGRAM_BINS; i++) histogram[i] += o.histogram[i];
+        windows += o.windows;
+        filterErrors += o.filterErrors;
+        if (o.filteredMinMm >= 0 && (filteredMinMm < 0 || o.filteredMinMm < filteredMinMm)) {
+            filteredMinMm = o.filteredMinMm;
+        }
+        if (o.filteredMaxMm > filteredMaxMm) filteredMaxMm = o.filteredMaxMm;
+        filteredSumMm += o.filteredSumMm;
+    }
+
+    /// Returns the center of the histogram bin holding the given percentile.
+    long percentileMm(double p) const {
+        uint64_t valid = pings - timeouts;
+        if (valid == 0) return -1;
+        uint64_t rank = (uint64_t)(p * (valid - 1));
+        uint64_t seen = 0;
+        for (int i = 0; i < HISTOGRAM_BINS; i++) {
+            seen += histogram[i];
+            if (seen > rank) return i * HISTOGRAM_BIN_MM + HISTOGRAM_BIN_MM / 2;
+        }
+        return -1;
+    }
+};
+
+/// Per-thread results; only touched by the owning worker.
+struct WorkerState {
+    std::unordered_map<std::string_view, UnitSummary> units;
+    std::vector<WindowFragment> fragments;
+    uint64_t records = 0;
+    uint64_t malformed = 0;
+};
+
+/// Tracks the open filter window of one unit inside one chunk.
+struct OpenWindow {
+    long window = 0;
+    bool firstInChunk = true;
+    Average<long> average;
+};
+
+// --- Parsing ---
+
+bool parseLong(const char*& p, const char* end, long& out) {
+    bool negative = false;
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9') return false;
+    long value = 0;
+    int digits = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (++digits > MAX_DIGITS) return false;
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    out = negative ? -value : value;
+    return true;
+}
+
+/// Flushes a finished window: interior windows are final, boundary ones become fragments.
+void closeWindow(WorkerState& state, UnitSummary& unit, std::string_view id, const OpenWindow& open) {
+    if (open.firstInChunk) {
+        state.fragments.push_back({id, open.window, open.average});
+    } else {
+        unit.addWindow(open.average);
+    }
+}
+
+void processChunk(const Chunk& chunk, const Options& options, WorkerState& state) {
+    std::unordered_map<std::string_view, OpenWindow> open;
+    const char* p = chunk.begin;
+
+    while (p < chunk.end) {
+        const char* lineEnd = (const char*)memchr(p, '\n', chunk.end - p);
+        if (lineEnd == nullptr) lineEnd = chunk.end;
+        const char* line = p;
+        p = lineEnd + 1;
+
+        if (line == lineEnd || *line == '#' || *line == '\r') continue;
+
+        const char* comma = (const char*)memchr(line, ',', lineEnd - line);
+        long millis = 0;
+        long duration = 0;
+        long temp = options.tempDeciC;
+        const char* q = comma != nullptr ? comma + 1 : lineEnd;
+        if (comma == nullptr || comma == line || !parseLong(q, lineEnd, millis) || q >= lineEnd ||
+            *q++ != ',' || !parseLong(q, lineEnd, duration)) {
+            state.malformed++;
+            continue;
+        }
+        if (q < lineEnd && *q == ',') {
+            q++;
+            if (!parseLong(q, lineEnd, temp) || temp < MIN_TEMP_DECI_C || temp > MAX_TEMP_DECI_C) {
+                state.malformed++;
+                continue;
+            }
+        }
+        // pulseIn() never returns more than the timeout: anything outside
+        // 0..ECHO_TIMEOUT_US is a corrupt record, and would also overflow the
+        // 32-bit conversion into a plausible-looking distance.
+        if (duration < 0 || duration > ZlabUltrasonicMath::ECHO_TIMEOUT_US) {
+            state.malformed++;
+            continue;
+        }
+
+        std::string_view id(line, comma - line);
+        UnitSummary& unit = state.units[id];
+        state.records++;
+
+        // Exactly the driver's conversion: timeouts (0) map to a negative distance.
+        long mm = ZlabUltrasonicMath::durationToMm(
+            duration, ZlabUltrasonicMath::speedOfSoundCmPerS((int16_t)temp));
+        unit.pings++;
+        if (mm < 0) {
+            unit.timeouts++;
+        } else {
+            unit.addDistance(mm);
+        }
+
+        // Feed the moving-average filter, one window per 100 ms of log time.
+        long window = millis / ZlabUltrasonicMath::AVERAGE_WINDOW_MS;
+        auto it = open.find(id);
+        if (it == open.end()) {
+            it = open.emplace(id, OpenWindow()).first;
+            it->second.window = window;
+        } else if (it->second.window != window) {
+            closeWindow(state, unit, id, it->second);
+            it->second = OpenWindow();
+            it->second.window = window;
+            it->second.firstInChunk = false;
+        }
+        it->second.average.add(mm);
+    }
+
+    // The last window of every unit may continue in the next chunk.
+    for (auto& entry : open) {
+        entry.second.firstInChunk = true;
+        closeWindow(state, state.units[entry.first], entry.first, entry.second);
+    }
+}
+
+// --- Input ---
+
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+bool mapFile(const char* path, MappedFile& out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return false;
+    }
+    out.size = (size_t)st.st_size;
+    if (out.size > 0) {
+        void* data = mmap(nullptr, out.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror(path);
+            close(fd);
+            return false;
+        }
+        madvise(data, out.size, MADV_WILLNEED);
+        out.data = (const char*)data;
+    }
+    close(fd);
+    return true;
+}
+
+/// Splits a mapped file into chunks of roughly chunkBytes, cut after a newline.
+void splitFile(const MappedFile& file, size_t chunkBytes, std::vector<Chunk>& chunks) {
+    const char* p = file.data;
+    const char* end = file.data + file.size;
+    while (p < end) {
+        const char* cut = p + std::min(chunkBytes, (size_t)(end - p));
+        if (cut < end) {
+            const char* nl = (const char*)memchr(cut, '\n', end - cut);
+            cut = nl == nullptr ? end : nl + 1;
+        }
+        chunks.push_back({p, cut});
+        p = cut;
+    }
+}
+
+void printUsage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options] <log>...\n"
+            "  -j N         worker threads (default: one per core)\n"
+            "  --chunk-mb N chunk size in MiB (default: 4)\n"
+            "  --temp N     temperature in 0.1 C for records without one (default: 200)\n"
+            "  --histogram  also print the distance histogram per unit\n"
+            "  -q           do not print throughput to stderr\n",
+            argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    std::vector<const char*> paths;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            options.threads = (unsigned)atoi(argv[++i]);
+        } else if (arg == "--chunk-mb" && i + 1 < argc) {
+            options.chunkBytes = (size_t)std::max(1, atoi(argv[++i])) << 20;
+        } else if (arg == "--temp" && i + 1 < argc) {
+            const char* value = argv[++i];
+            const char* end = value + strlen(value);
+            long temp = 0;
+            if (!parseLong(value, end, temp) || value != end || temp < MIN_TEMP_DECI_C ||
+                temp > MAX_TEMP_DECI_C) {
+                fprintf(stderr, "--temp must be between %ld and %ld (0.1 C)\n", MIN_TEMP_DECI_C,
+                        MAX_TEMP_DECI_C);
+                return 2;
+            }
+            options.tempDeciC = (int16_t)temp;
+        } else if (arg == "--histogram") {
+            options.histogram = true;
+        } else if (arg == "-q") {
+            options.quiet = true;
+        } else if (arg == "-h" || arg == "--help" || arg[0] == '-') {
+            printUsage(argv[0]);
+            return arg[0] == '-' && arg != "-h" && arg != "--help" ? 2 : 0;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    if (options.threads == 0) {
+        options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Files stay mapped until exit: unit ids are string_views into them.
+    std::vector<MappedFile> files(paths.size());
+    std::vector<Chunk> chunks;
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (!mapFile(paths[i], files[i])) return 1;
+        splitFile(files[i], options.chunkBytes, chunks);
+        totalBytes += files[i].size;
+    }
+
+    WorkStealingPool<Chunk> pool(options.threads);
+    for (const Chunk& chunk : chunks) pool.submit(chunk);
+
+    std::vector<WorkerState> workers(pool.size());
+    pool.run([&](unsigned w, const Chunk& chunk) { processChunk(chunk, options, workers[w]); });
+
+    // Merge per-worker results; std::map keeps the output sorted by unit.
+    std::map<std::string_view, UnitSummary> units;
+    std::map<std::pair<std::string_view, long>, WindowFragment> windows;
+    uint64_t records = 0;
+    uint64_t malformed = 0;
+    for (WorkerState& state : workers) {
+        records += state.records;
+        malformed += state.malformed;
+        for (auto& entry : state.units) units[entry.first].merge(entry.second);
+        for (const WindowFragment& f : state.fragments) {
+            WindowFragment& merged = windows[{f.unit, f.window}];
+            merged.average.merge(f.average);
+        }
+    }
+    for (auto& entry : windows) units[entry.first.first].addWindow(entry.second.average);
+
+    printf("unit,pings,timeouts,timeout_rate,min_mm,p50_mm,p90_mm,p99_mm,max_mm,mean_mm,"
+           "windows,filter_errors,filtered_mean_mm,filtered_min_mm,filtered_max_mm\n");
+    for (auto& entry : units) {
+        const UnitSummary& u = entry.second;
+        uint64_t valid = u.pings - u.timeouts;
+        uint64_t filtered = u.windows - u.filterErrors;
+        printf("%.*s,%llu,%llu,%.4f,%ld,%ld,%ld,%ld,%ld,%.1f,%llu,%llu,%.1f,%ld,%ld\n",
+               (int)entry.first.size(), entry.first.data(),
+               (unsigned long long)u.pings, (unsigned long long)u.timeouts,
+               u.pings ? (double)u.timeouts / u.pings : 0.0,
+               u.minMm, u.percentileMm(0.50), u.percentileMm(0.90), u.percentileMm(0.99), u.maxMm,
+               valid ? (double)u.sumMm / valid : -1.0,
+               (unsigned long long)u.windows, (unsigned long long)u.filterErrors,
+               filtered ? (double)u.filteredSumMm / filtered : -1.0,
+               u.filteredMinMm, u.filteredMaxMm);
+    }
+
+    if (options.histogram) {
+        printf("\nunit,bin_start_mm,count\n");
+        for (auto& entry : units) {
+            for (int i = 0; i < HISTOGRAM_BINS; i++) {
+                if (entry.second.histogram[i] == 0) continue;
+                printf("%.*s,%ld,%llu\n", (int)entry.first.size(), entry.first.data(),
+                       i * HISTOGRAM_BIN_MM, (unsigned long long)entry.second.histogram[i]);
+            }
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!options.quiet) {
+        fprintf(stderr,
+                "%llu records (%llu malformed), %zu chunks, %u threads: %.3f s, %.1f MB/s, %.2f M records/s\n",
+                (unsigned long long)records, (unsigned long long)malformed, chunks.size(), pool.size(),
+                seconds, totalBytes / 1e6 / seconds, records / 1e6 / seconds);
+    }
+    return 0;
+}
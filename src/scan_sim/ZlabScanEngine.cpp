@@ -0,0 +1,7 @@
+/**
+ * @file ZlabScanEngine.cpp
+ * @brief Compiles the library's portable scan engine into the simulator.
+ * @details The native environments ignore the ZlabUltrasonic library, whose
+ * driver sources need the Arduino core; the one portable source is built here.
+ */
+#include "ZlabScan.cpp"
@@ -0,0 +1,338 @@
+/**
+ * @file main.cpp
+ * @brief scan-sim: runs ZlabScanEngine against a simulated servo, sensor and room.
+ * @details Host-side (Linux) benchmark. Compares the pipelined engine with the
+ * usual application loop (setAngle, fixed settle delay, blocking read) in
+ * simulated time, checks that no ping fires while the servo is still moving,
+ * and measures the host CPU cost of the engine and incremental grid updates.
+ * The check runs with a non-blocking sensor (like ZlabEchoCaptureScanSensor)
+ * and with one that blocks for the whole echo inside startPing() (like
+ * ZlabUltrasonicScanSensor), and also fails if a trigger reaches a sensor that
+ * is still holding ECHO for a missed echo.
+ *
+ * Build and run: pio run -e scan_sim && .pio/build/scan_sim/program
+ */
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "ZlabScan.h"
+
+namespace {
+
+const long SPEED_OF_SOUND_MM_PER_MS = 343;  // 20°C
+const uint32_t BURST_LATENCY_US = 450;      // HC-SR04 trigger to burst
+const long MAX_RANGE_MM = 4000;
+const uint32_t ECHO_TIMEOUT_US = ZlabUltrasonicMath::ECHO_TIMEOUT_US; // reader gives up
+const uint32_t NO_ECHO_HOLD_US = 38000; // HC-SR04 holds ECHO this long when nothing answers
+
+/// A rectangular room with one movable box, sensor at the middle of the near wall.
+struct Room {
+    float halfWidthMm = 2000;
+    float depthMm = 3000;
+    float boxX = 600, boxY = 1200, boxHalf = 200; // obstacle center and half size
+
+    /// Distance along the bearing to the first surface, or -1 beyond MAX_RANGE_MM.
+    long rayMm(float angleDeg) const {
+        float rad = angleDeg * (float)M_PI / 180.0f;
+        float dx = cosf(rad), dy = sinf(rad);
+        float best = 1e9f;
+        // Walls.
+        if (dx > 1e-6f) best = std::min(best, halfWidthMm / dx);
+        if (dx < -1e-6f) best = std::min(best, -halfWidthMm / dx);
+        if (dy > 1e-6f) best = std::min(best, depthMm / dy);
+        // Axis-aligned box (slab test).
+        float tmin = 0, tmax = 1e9f;
+        const float lo[2] = {boxX - boxHalf, boxY - boxHalf};
+        const float hi[2] = {boxX + boxHalf, boxY + boxHalf};
+        const float d[2] = {dx, dy};
+        bool hit = true;
+        for (int i = 0; i < 2 && hit; i++) {
+            if (fabsf(d[i]) < 1e-6f) {
+                hit = 0 >= lo[i] && 0 <= hi[i];
+            } else {
+                float t1 = lo[i] / d[i], t2 = hi[i] / d[i];
+                tmin = std::max(tmin, std::min(t1, t2));
+                tmax = std::min(tmax, std::max(t1, t2));
+                hit = tmin <= tmax;
+            }
+        }
+        if (hit) best = std::min(best, tmin);
+        return best > MAX_RANGE_MM ? -1 : lroundf(best);
+    }
+};
+
+/// Servo with constant slew rate plus ringing time after arrival.
+class SimServo : public ZlabServoDriver {
+public:
+    SimServo(uint32_t& clock, uint32_t usPerDeg, uint32_t settleUs)
+        : _clock(clock), _usPerDeg(usPerDeg), _settleUs(settleUs) {}
+
+    void setAngle(int16_t angleDeg) override {
+        _from = angleAt(_clock);
+        _to = angleDeg;
+        _start = _clock;
+        moves++;
+    }
+
+    /// Shaft angle at time t (linear travel).
+    float angleAt(uint32_t t) const {
+        uint32_t travel = (uint32_t)(fabsf(_to - _from) * _usPerDeg);
+        if (t - _start >= travel || travel == 0) return _to;
+        return _from + (_to - _from) * (float)(t - _start) / travel;
+    }
+
+    /// True once travel and ringing are over.
+    bool settledAt(uint32_t t) const {
+        uint32_t travel = (uint32_t)(fabsf(_to - _from) * _usPerDeg);
+        return t - _start >= travel + _settleUs;
+    }
+
+    uint32_t moves = 0;
+
+private:
+    uint32_t& _clock;
+    uint32_t _usPerDeg, _settleUs;
+    float _from = 0, _to = 0;
+    uint32_t _start = 0;
+};
+
+/// HC-SR04 model: the bearing is sampled when the burst leaves. Without an echo
+/// the sensor stays busy for NO_ECHO_HOLD_US, although the reader gives up after
+/// ECHO_TIMEOUT_US, and a trigger while it is busy is ignored (read as a timeout).
+class SimSensor : public ZlabRangeSensor {
+public:
+    SimSensor(const Room& room, const SimServo& servo) : _room(room), _servo(servo) {}
+
+    void startPing(uint32_t now_us) override {
+        pings++;
+        if (_busy && (int32_t)(now_us - _busyUntil) < 0) {
+            ignoredTriggers++;
+            _result = -1;
+            _readyAt = now_us + ECHO_TIMEOUT_US;
+            return;
+        }
+        uint32_t burst = now_us + BURST_LATENCY_US;
+        if (!_servo.settledAt(burst)) unsettledPings++;
+        _result = _room.rayMm(_servo.angleAt(burst));
+        if (_result < 0) {
+            _readyAt = burst + ECHO_TIMEOUT_US;
+            _busyUntil = burst + NO_ECHO_HOLD_US;
+        } else {
+            _readyAt = burst + (uint32_t)(2 * _result * 1000 / SPEED_OF_SOUND_MM_PER_MS);
+            _busyUntil = _readyAt;
+        }
+        _busy = true;
+    }
+
+    bool pollResult(uint32_t now_us, long& distance_mm) override {
+        if ((int32_t)(now_us - _readyAt) < 0) return false;
+        distance_mm = _result;
+        return true;
+    }
+
+    uint32_t readyAt() const { return _readyAt; }
+    uint32_t pings = 0;
+    uint32_t unsettledPings = 0;
+    uint32_t ignoredTriggers = 0;
+
+private:
+    const Room& _room;
+    const SimServo& _servo;
+    long _result = -1;
+    uint32_t _readyAt = 0;
+    uint32_t _busyUntil = 0;
+    bool _busy = false;
+};
+
+/// Same sensor read with a blocking call: startPing() returns once the echo is in.
+class BlockingSimSensor : public SimSensor {
+public:
+    BlockingSimSensor(const Room& room, const SimServo& servo, uint32_t& clock)
+        : SimSensor(room, servo), _clock(clock) {}
+
+    void startPing(uint32_t now_us) override {
+        SimSensor::startPing(now_us);
+        _clock = readyAt(); // pulseIn() holds the CPU until the echo ends
+    }
+
+    /// The result is always in by now, whatever timestamp the engine passes.
+    bool pollResult(uint32_t now_us, long& distance_mm) override {
+        (void)now_us;
+        return SimSensor::pollResult(readyAt(), distance_mm);
+    }
+
+private:
+    uint32_t& _clock;
+};
+
+typedef ZlabPolarGrid<181> PolarGrid;
+typedef ZlabOccupancyGrid<96, 80> OccupancyGrid;
+
+/// The usual application loop: step, wait a fixed settle delay, blocking read.
+uint32_t naiveSweepUs(const Room& room, const ZlabScanConfig& cfg, uint32_t settleDelayUs,
+                      PolarGrid& grid) {
+    uint32_t clock = 0;
+    SimServo servo(clock, cfg.servoUsPerDeg, cfg.servoSettleUs);
+    SimSensor sensor(room, servo);
+    servo.setAngle(cfg.endDeg); // previous sweep ended at the far side
+    clock += (cfg.endDeg - cfg.startDeg) * cfg.servoUsPerDeg + cfg.servoSettleUs;
+
+    uint32_t begin = clock;
+    uint16_t bin = 0;
+    for (int16_t a = cfg.startDeg; a <= cfg.endDeg; a += cfg.stepDeg, bin++) {
+        servo.setAngle(a);
+        clock += settleDelayUs; // delay(settle)
+        sensor.startPing(clock);
+        long mm;
+        clock = std::max(clock, sensor.readyAt()); // blocking getDistance()
+        sensor.pollResult(clock, mm);
+        grid.onReading(bin, a, mm);
+    }
+    return clock - begin;
+}
+
+struct EngineRun {
+    uint32_t sweepUs = 0;
+    uint32_t unsettled = 0;
+    uint32_t ignored = 0;
+    uint32_t pings = 0;
+    double hostNsPerReading = 0;
+};
+
+/// Runs the pipelined engine for `sweeps` sweeps, moving the box before the last one.
+EngineRun engineSweeps(Room room, const ZlabScanConfig& cfg, int sweeps, bool blocking, PolarGrid& grid,
+                       OccupancyGrid& occupancy, uint32_t* lastSweepChanges) {
+    uint32_t clock = 0;
+    SimServo servo(clock, cfg.servoUsPerDeg, cfg.servoSettleUs);
+    SimSensor plain(room, servo);
+    BlockingSimSensor blockingSensor(room, servo, clock);
+    SimSensor& sensor = blocking ? blockingSensor : plain;
+    ZlabScanEngine engine(servo, sensor, grid, cfg);
+    grid.setListener(&occupancy);
+
+    EngineRun run;
+    double hostNs = 0;
+    uint32_t readings = 0;
+    uint32_t sweepStart = 0;
+    engine.begin(clock);
+    while ((int)engine.sweeps() < sweeps) {
+        // Jump straight to the next event instead of spinning the virtual clock.
+        uint32_t next = engine.isPinging() ? sensor.readyAt() : engine.nextPingUs();
+        if ((int32_t)(next - clock) > 0) clock = next;
+
+        uint32_t before = engine.sweeps();
+        auto t0 = std::chrono::steady_clock::now();
+        bool reading = engine.update(clock);
+        hostNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        if (reading) readings++;
+        if (engine.sweeps() != before) {
+            // The first sweep includes the initial move, so time a later one.
+            if (engine.sweeps() > 1) run.sweepUs = clock - sweepStart;
+            sweepStart = clock;
+            if ((int)engine.sweeps() == sweeps - 1) {
+                room.boxX -= 300; // something moved before the last sweep
+                *lastSweepChanges = grid.changes();
+            }
+        }
+    }
+    *lastSweepChanges = grid.changes() - *lastSweepChanges;
+    run.unsettled = sensor.unsettledPings;
+    run.ignored = sensor.ignoredTriggers;
+    run.pings = sensor.pings;
+    run.hostNsPerReading = readings ? hostNs / readings : 0;
+    return run;
+}
+
+void printGrid(const OccupancyGrid& occupancy, int w, int h) {
+    for (int y = h - 1; y >= 0; y -= 2) {
+        putchar(' ');
+        for (int x = 0; x < w; x++) putchar(occupancy.occupied(x, y) || occupancy.occupied(x, y - 1) ? '#' : '.');
+        putchar('\n');
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    ZlabScanConfig cfg;
+    uint32_t naiveSettleUs = 60000; // typical fixed delay(60) between steps
+    int sweeps = 4;
+    bool draw = false;
+    int stepDeg = cfg.stepDeg;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--step") && i + 1 < argc) stepDeg = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--naive-settle-ms") && i + 1 < argc) naiveSettleUs = 1000u * atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--sweeps") && i + 1 < argc) sweeps = std::max(2, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--ping-interval-ms") && i + 1 < argc)
+            cfg.minPingIntervalUs = (uint16_t)(1000u * std::min(65, std::max(0, atoi(argv[++i]))));
+        else if (!strcmp(argv[i], "--draw")) draw = true;
+        else {
+            fprintf(stderr, "usage: %s [--step DEG] [--naive-settle-ms MS] [--sweeps N] [--ping-interval-ms MS] [--draw]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    // A step below 1 deg never reaches endDeg.
+    if (stepDeg < 1 || stepDeg > cfg.endDeg - cfg.startDeg) {
+        fprintf(stderr, "--step must be 1..%d deg\n", cfg.endDeg - cfg.startDeg);
+        return 2;
+    }
+    cfg.stepDeg = (int16_t)stepDeg;
+
+    Room room;
+    PolarGrid naiveGrid;
+    uint32_t naiveUs = naiveSweepUs(room, cfg, naiveSettleUs, naiveGrid);
+
+    PolarGrid grid;
+    OccupancyGrid occupancy;
+    uint32_t lastChanges = 0;
+    EngineRun run = engineSweeps(room, cfg, sweeps, false, grid, occupancy, &lastChanges);
+
+    PolarGrid blockingGrid;
+    OccupancyGrid blockingOccupancy;
+    uint32_t blockingChanges = 0;
+    EngineRun blockingRun = engineSweeps(room, cfg, sweeps, true, blockingGrid, blockingOccupancy,
+                                         &blockingChanges);
+
+    // Far wall out of range: the middle bearings time out, and the sensor stays
+    // busy for its full no-echo hold.
+    Room open = room;
+    open.depthMm = 2 * MAX_RANGE_MM;
+    PolarGrid openGrid, openBlockingGrid;
+    OccupancyGrid openOccupancy, openBlockingOccupancy;
+    uint32_t openChanges = 0, openBlockingChanges = 0;
+    EngineRun openRun = engineSweeps(open, cfg, sweeps, false, openGrid, openOccupancy, &openChanges);
+    EngineRun openBlockingRun = engineSweeps(open, cfg, sweeps, true, openBlockingGrid,
+                                             openBlockingOccupancy, &openBlockingChanges);
+    const EngineRun* checks[] = {&run, &blockingRun, &openRun, &openBlockingRun};
+    bool clean = true;
+    for (const EngineRun* r : checks) clean = clean && r->unsettled == 0 && r->ignored == 0;
+
+    uint16_t bins = (uint16_t)((cfg.endDeg - cfg.startDeg) / cfg.stepDeg + 1);
+    printf("sweep %d..%d deg, step %d deg, %u readings per sweep\n", cfg.startDeg, cfg.endDeg,
+           cfg.stepDeg, bins);
+    printf("naive loop (delay %u ms + blocking read): %8.1f ms per sweep\n", naiveSettleUs / 1000,
+           naiveUs / 1000.0);
+    printf("pipelined engine:                         %8.1f ms per sweep (%.2fx)\n", run.sweepUs / 1000.0,
+           (double)naiveUs / run.sweepUs);
+    printf("  with a blocking sensor:                 %8.1f ms per sweep (%.2fx)\n",
+           blockingRun.sweepUs / 1000.0, (double)naiveUs / blockingRun.sweepUs);
+    printf("pings unsettled / ignored by a busy sensor:\n");
+    printf("  non-blocking sensor:                    %u / %u of %u\n", run.unsettled, run.ignored, run.pings);
+    printf("  blocking sensor:                        %u / %u of %u\n", blockingRun.unsettled,
+           blockingRun.ignored, blockingRun.pings);
+    printf("  non-blocking, far wall out of range:    %u / %u of %u\n", openRun.unsettled, openRun.ignored,
+           openRun.pings);
+    printf("  blocking, far wall out of range:        %u / %u of %u\n", openBlockingRun.unsettled,
+           openBlockingRun.ignored, openBlockingRun.pings);
+    printf("bins changed in last sweep (box moved):   %u of %u\n", lastChanges, bins);
+    printf("occupancy cell writes, all sweeps:        %u\n", occupancy.touched());
+    printf("host cost per engine update + grid write: %.0f ns\n", run.hostNsPerReading);
+    if (draw) printGrid(occupancy, 96, 80);
+    return clean ? 0 : 1;
+}
@@ -1,6 +1,9 @@
 // test/test_main.cpp
 #include <AUnit.h>
 #include "ZlabUltrasonic.h"
+#include "ZlabUltrasonicMath.h"
+#include "ZlabScan.h"
+#include "ZlabEchoCapture.h"
 
 // We can't test hardware directly, so we mock it or test logic.
 // Here, we can test the logic of unit conversion and temperature compensation.
@@ -25,6 +28,103 @@ test(TemperatureCompensation) {
     assertTrue(speedOfSoundAt35C > speedOfSoundAt0C);
 }
 
+test(IntegerDistanceMatchesFloat) {
+    // 923µs at 25°C was measured as ~15.98 cm (see TEST_LOG.md, Test #1).
+    uint32_t speed = ZlabUltrasonicMath::speedOfSoundCmPerS(250);
+    assertEqual(ZlabUltrasonicMath::durationToMm(923, speed), 160L);
+    assertEqual(String(ZlabUltrasonicMath::durationToCm(923, 25.0f), 2), "15.99");
+    assertTrue(ZlabUltrasonicMath::durationToMm(0, speed) < 0);
+}
+
+test(MovingAverageSkipsInvalidReadings) {
+    ZlabUltrasonicMath::Average<long> average;
+    assertTrue(average.result() < 0);
+    average.add(100);
+    average.add(-1); // timeout
+    average.add(103);
+    assertEqual(average.result(), 102L);
+}
+
+test(EchoPredictorExtrapolates) {
+    ZlabUltrasonicMath::EchoPredictor predictor;
+    predictor.update(1000);
+    assertFalse(predictor.ready());
+    predictor.update(1100);
+    assertTrue(predictor.ready());
+    assertEqual(predictor.predicted(), 1200L);
+    assertEqual(predictor.guard(150), 350L);
+
+    // A timeout forces the next reading back to a full-range search.
+    predictor.update(0);
+    assertFalse(predictor.ready());
+}
+
+test(PolarGridReportsOnlyChangedBins) {
+    ZlabPolarGrid<4> grid(20);
+    grid.onReading(0, 0, 1000);
+    grid.onReading(0, 0, 1005); // Same 20 mm step: no change.
+    assertEqual(grid.changes(), (uint32_t)1);
+    assertEqual(grid.distanceMm(0), 1000L);
+
+    grid.onReading(0, 0, -1);
+    assertEqual(grid.cell(0), ZlabPolarGrid<4>::NO_ECHO);
+    assertTrue(grid.distanceMm(0) < 0);
+    assertEqual(grid.changes(), (uint32_t)2);
+}
+
+test(EdgePairerHandlesOverlappingEchoes) {
+    ZlabEdgeQueue<8> queue;
+    ZlabEdgePairer<2> pairer;
+    pairer.arm(0, 0);
+    pairer.arm(1, 0);
+
+    // Both echoes in flight at once; channel 1 returns first.
+    queue.push({500, 0, 1});
+    queue.push({510, 1, 1});
+    queue.push({1510, 1, 0});
+    queue.push({2500, 0, 0});
+
+    ZlabEdgeEvent event;
+    while (queue.pop(event)) {
+        pairer.process(event);
+    }
+    assertTrue(pairer.available(0));
+    assertTrue(pairer.available(1));
+    assertEqual(pairer.take(0), 2000L);
+    assertEqual(pairer.take(1), 1000L);
+}
+
+test(EdgePairerIgnoresEdgesBeforeRearm) {
+    ZlabEdgeQueue<8> queue;
+    ZlabEdgePairer<1> pairer;
+    pairer.arm(0, 0);
+
+    // The previous echo is still queued when the channel is triggered again.
+    queue.push({100, 0, 1});
+    queue.push({200, 0, 0});
+    pairer.arm(0, 1000);
+    queue.push({1500, 0, 1});
+    queue.push({2500, 0, 0});
+
+    ZlabEdgeEvent event;
+    while (queue.pop(event)) {
+        pairer.process(event);
+    }
+    assertTrue(pairer.available(0));
+    assertEqual(pairer.take(0), 1000L);
+}
+
+test(EdgePairerIgnoresInvalidChannels) {
+    ZlabEdgePairer<2> pairer;
+    // A failed addChannel() returns -1, which arrives here as 255.
+    uint8_t invalid = (uint8_t)-1;
+    pairer.arm(invalid, 0);
+    assertFalse(pairer.inFlight(invalid));
+    assertFalse(pairer.available(invalid));
+    assertEqual(pairer.take(invalid), 0L);
+    assertFalse(pairer.available(2));
+}
+
 void setup() {
     Serial.begin(115200);
     while (!Serial); // wait for serial port to connect